@@ -0,0 +1,361 @@
+#include "common.h"
+#include "graph_io.h"
+#include "input_parser.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+using std::string;
+using std::vector;
+
+// Runs every solver on every dataset a few times and reports time, FAS size,
+// peak memory and where the time went. Each run is a forked child, so a run
+// that hangs can be killed, peak RSS is per run, and the globals a solver
+// sets don't leak into the next one. POSIX only.
+
+enum class RunStatus { OK, TIMEOUT, INVALID, FAILED };
+
+const char *describe(RunStatus status) {
+  switch (status) {
+  case RunStatus::OK:
+    return "ok";
+  case RunStatus::TIMEOUT:
+    return "timeout";
+  case RunStatus::INVALID:
+    return "invalid";
+  default:
+    return "failed";
+  }
+}
+
+struct phase_t {
+  string name;
+  long count = 0;
+  int64_t total_ns = 0;
+};
+
+struct run_t {
+  RunStatus status = RunStatus::FAILED;
+  int64_t time_ns = 0;
+  size_t fas_size = 0;
+  // Of the child process, which includes the graph it was forked with.
+  int64_t peak_rss_bytes = -1;
+  vector<phase_t> phases;
+};
+
+// All runs of one solver on one dataset.
+struct result_t {
+  string solver;
+  string dataset;
+  int vertices = 0;
+  size_t edges = 0;
+  RunStatus status = RunStatus::OK;
+  vector<int64_t> times_ns;
+  size_t fas_size = 0;
+  int64_t peak_rss_bytes = -1;
+  // Of the fastest run.
+  vector<phase_t> phases;
+};
+
+// Exit code of a child whose FAS didn't pass validate_fas.
+constexpr int INVALID_EXIT_CODE = 2;
+
+// Child side of run(): solves, then writes "<time_ns> <fas_size>" and one
+// "<count> <total_ns> <name>" line per phase to fd.
+[[noreturn]] void solve_child(const fas_solver &solver, const CSRGraph &g,
+                              int timeout_s, bool validate, int fd) {
+  trace_enabled = true;
+  trace_reset();
+  // The default action of SIGALRM ends the process.
+  alarm(timeout_s);
+  const auto start = std::chrono::steady_clock::now();
+  const FAS fas = solver(g);
+  const auto end = std::chrono::steady_clock::now();
+  alarm(0);
+  const vector<trace_total_t> totals = trace_totals();
+  trace_enabled = false;
+  if (validate && validate_fas(g, fas, fas_threads) != FasStatus::VALID) {
+    _exit(INVALID_EXIT_CODE);
+  }
+  FILE *out = fdopen(fd, "w");
+  if (out == nullptr) {
+    _exit(1);
+  }
+  fprintf(out, "%lld %zu\n",
+          static_cast<long long>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                  .count()),
+          fas.size());
+  for (const trace_total_t &total : totals) {
+    fprintf(out, "%ld %lld %s\n", total.count,
+            static_cast<long long>(total.total_ns), total.name);
+  }
+  _exit(fclose(out) == 0 ? 0 : 1);
+}
+
+// Solves g once in a child process.
+// @param name : a solver name, see solver_names().
+// @param timeout_s : seconds after which the child is killed, 0 = no limit.
+// @param validate : check the FAS with validate_fas, outside the timing.
+run_t run(const string &name, const CSRGraph &g, int timeout_s,
+          bool validate) {
+  run_t result;
+  fas_solver solver;
+  int fds[2];
+  if (!select_solver(name, solver) || pipe(fds) != 0) {
+    return result;
+  }
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return result;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    solve_child(solver, g, timeout_s, validate, fds[1]);
+  }
+  close(fds[1]);
+  // Read before waiting, so a full pipe can't block the child.
+  FILE *in = fdopen(fds[0], "r");
+  long long time_ns = 0;
+  bool parsed = in != nullptr &&
+                fscanf(in, "%lld %zu\n", &time_ns, &result.fas_size) == 2;
+  long count;
+  long long total_ns;
+  char phase_name[256];
+  while (parsed &&
+         fscanf(in, "%ld %lld %255s\n", &count, &total_ns, phase_name) == 3) {
+    result.phases.push_back({phase_name, count, total_ns});
+  }
+  if (in != nullptr) {
+    fclose(in);
+  } else {
+    close(fds[0]);
+  }
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    return result;
+  }
+  // Kilobytes on Linux
+  result.peak_rss_bytes = static_cast<int64_t>(usage.ru_maxrss) * 1024;
+  result.time_ns = time_ns;
+  if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+    result.status = RunStatus::TIMEOUT;
+  } else if (WIFEXITED(status) && WEXITSTATUS(status) == INVALID_EXIT_CODE) {
+    result.status = RunStatus::INVALID;
+  } else if (parsed && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    result.status = RunStatus::OK;
+  }
+  return result;
+}
+
+int64_t median(vector<int64_t> values) {
+  std::sort(values.begin(), values.end());
+  const size_t mid = values.size() / 2;
+  return values.size() % 2 == 1 ? values[mid]
+                                : (values[mid - 1] + values[mid]) / 2;
+}
+
+double fas_percentage(const result_t &r) {
+  return r.edges == 0 ? 0 : r.fas_size * 100.0 / r.edges;
+}
+
+// Splits "a,b,c".
+vector<string> split(const string &list) {
+  vector<string> items;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == string::npos) {
+      end = list.size();
+    }
+    if (end > begin) {
+      items.push_back(list.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return items;
+}
+
+string json_string(const string &s) {
+  string quoted = "\"";
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+bool write_json(const string &filename, const vector<result_t> &results) {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fputs("[\n", file);
+  for (size_t i = 0; i < results.size(); i++) {
+    const result_t &r = results[i];
+    fprintf(file,
+            "{\"solver\":%s,\"dataset\":%s,\"vertices\":%d,\"edges\":%zu,"
+            "\"status\":\"%s\",\"runs\":%zu",
+            json_string(r.solver).c_str(), json_string(r.dataset).c_str(),
+            r.vertices, r.edges, describe(r.status), r.times_ns.size());
+    if (!r.times_ns.empty()) {
+      fprintf(file,
+              ",\"min_ms\":%.3f,\"median_ms\":%.3f,\"fas_size\":%zu,"
+              "\"fas_percent\":%.4f,\"peak_rss_bytes\":%lld",
+              *std::min_element(r.times_ns.begin(), r.times_ns.end()) * 1e-6,
+              median(r.times_ns) * 1e-6, r.fas_size, fas_percentage(r),
+              static_cast<long long>(r.peak_rss_bytes));
+    }
+    fputs(",\"phases\":[", file);
+    for (size_t k = 0; k < r.phases.size(); k++) {
+      fprintf(file, "%s{\"name\":%s,\"count\":%ld,\"total_ms\":%.3f}",
+              k == 0 ? "" : ",", json_string(r.phases[k].name).c_str(),
+              r.phases[k].count, r.phases[k].total_ns * 1e-6);
+    }
+    fputs(i + 1 == results.size() ? "]}\n" : "]},\n", file);
+  }
+  fputs("]\n", file);
+  return fclose(file) == 0;
+}
+
+// One row per solver and dataset; phases go in one column as
+// "name:total_ms;...".
+bool write_csv(const string &filename, const vector<result_t> &results) {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fputs("solver,dataset,vertices,edges,status,runs,min_ms,median_ms,"
+        "fas_size,fas_percent,peak_rss_bytes,phases\n",
+        file);
+  for (const result_t &r : results) {
+    fprintf(file, "%s,%s,%d,%zu,%s,%zu", r.solver.c_str(), r.dataset.c_str(),
+            r.vertices, r.edges, describe(r.status), r.times_ns.size());
+    if (!r.times_ns.empty()) {
+      fprintf(file, ",%.3f,%.3f,%zu,%.4f,%lld",
+              *std::min_element(r.times_ns.begin(), r.times_ns.end()) * 1e-6,
+              median(r.times_ns) * 1e-6, r.fas_size, fas_percentage(r),
+              static_cast<long long>(r.peak_rss_bytes));
+    } else {
+      fputs(",,,,,", file);
+    }
+    fputc(',', file);
+    for (size_t k = 0; k < r.phases.size(); k++) {
+      fprintf(file, "%s%s:%.3f", k == 0 ? "" : ";",
+              r.phases[k].name.c_str(), r.phases[k].total_ns * 1e-6);
+    }
+    fputc('\n', file);
+  }
+  return fclose(file) == 0;
+}
+
+const char *DEFAULT_DATASETS = "example,data/small_sample.txt,"
+                               "data/v300_e2731.txt,"
+                               "data/wordassociation-2011.txt,data/enron.txt";
+
+// benchmark.cc
+int main(int argc, const char *argv[]) {
+  InputParser parser(argc, argv);
+  vector<string> solvers = solver_names();
+  if (parser.option_exists("-s")) {
+    solvers = split(parser.get_option("-s"));
+  }
+  for (const string &name : solvers) {
+    fas_solver solver;
+    if (!select_solver(name, solver)) {
+      printf("Unknown solver '%s'\n", name.c_str());
+      return -1;
+    }
+  }
+  const vector<string> datasets = split(
+      parser.option_exists("-i") ? parser.get_option("-i") : DEFAULT_DATASETS);
+  int repeats = 3;
+  int timeout_s = 60;
+  for (const auto &[flag, value] :
+       {std::make_pair("-n", &repeats), std::make_pair("--timeout", &timeout_s),
+        std::make_pair("-j", &fas_threads)}) {
+    if (!parser.get_int(flag, *value)) {
+      printf("%s expects a number, got '%s'\n", flag,
+             parser.get_option(flag).c_str());
+      return -1;
+    }
+  }
+  const bool validate = parser.option_exists("-v");
+
+  vector<result_t> results;
+  bool failed = false;
+  printf("%-20s %-32s %6s %12s %12s %10s %8s %12s %8s\n", "Solver", "Dataset",
+         "Runs", "Min(ms)", "Median(ms)", "FAS", "FAS(%)", "PeakRSS(MB)",
+         "Status");
+  for (const string &dataset : datasets) {
+    CSRGraph g;
+    if (dataset == "example") {
+      g = example_graph();
+    } else if (const ReadStatus status = read_graph(dataset, g);
+               status != ReadStatus::OK) {
+      printf("%s: '%s', skipped\n", describe(status), dataset.c_str());
+      continue;
+    }
+    for (const string &solver : solvers) {
+      result_t r;
+      r.solver = solver;
+      r.dataset = dataset;
+      r.vertices = g.size();
+      r.edges = g.n_edges();
+      for (int i = 0; i < repeats; i++) {
+        run_t one = run(solver, g, timeout_s, validate);
+        if (one.status != RunStatus::OK) {
+          // The slow solvers won't do better on the next try.
+          r.status = one.status;
+          break;
+        }
+        if (r.times_ns.empty() ||
+            one.time_ns < *std::min_element(r.times_ns.begin(),
+                                            r.times_ns.end())) {
+          r.phases = std::move(one.phases);
+        }
+        r.times_ns.push_back(one.time_ns);
+        r.fas_size = one.fas_size;
+        r.peak_rss_bytes = std::max(r.peak_rss_bytes, one.peak_rss_bytes);
+      }
+      failed |= r.status == RunStatus::FAILED ||
+                r.status == RunStatus::INVALID;
+      printf("%-20s %-32s %6zu", solver.c_str(), dataset.c_str(),
+             r.times_ns.size());
+      if (!r.times_ns.empty()) {
+        printf(" %12.3f %12.3f %10zu %8.2f %12.3f",
+               *std::min_element(r.times_ns.begin(), r.times_ns.end()) * 1e-6,
+               median(r.times_ns) * 1e-6, r.fas_size, fas_percentage(r),
+               r.peak_rss_bytes / 1048576.0);
+      } else {
+        printf(" %12s %12s %10s %8s %12s", "-", "-", "-", "-", "-");
+      }
+      printf(" %8s\n", describe(r.status));
+      results.push_back(std::move(r));
+    }
+  }
+
+  const string &json_file = parser.get_option("-o");
+  if (!json_file.empty() && !write_json(json_file, results)) {
+    printf("Can't write '%s'\n", json_file.c_str());
+    return -1;
+  }
+  const string &csv_file = parser.get_option("-c");
+  if (!csv_file.empty() && !write_csv(csv_file, results)) {
+    printf("Can't write '%s'\n", csv_file.c_str());
+    return -1;
+  }
+  return failed ? -1 : 0;
+}
@@ -1,22 +1,68 @@
 #pragma once
+#include "csr_graph.h"
 #include <cstdint>
 #include <functional>
 #include <map>
-#include <stack>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 using SparseVec = std::unordered_map<int, char>;
-using SparseMatrix = std::vector<SparseVec>;
-using Edge = std::pair<int, int>;
+
+// Mutable hash-map form, only used where edges are deleted in place.
+// In-neighbor sets are kept next to the rows, so both degrees are O(1). Rows
+// are read-only from outside; edit through add_edge / remove_edge.
+class SparseMatrix {
+  std::vector<SparseVec> out_;
+  std::vector<SparseVec> in_;
+
+public:
+  SparseMatrix() = default;
+  explicit SparseMatrix(int n) : out_(n), in_(n) {}
+
+  int size() const { return out_.size(); }
+  // Out-neighbors of v
+  const SparseVec &operator[](int v) const { return out_[v]; }
+  const SparseVec &in(int v) const { return in_[v]; }
+  bool has_edge(int from, int to) const { return out_[from].count(to) != 0; }
+
+  // @return : false if the edge was already there.
+  bool add_edge(int from, int to) {
+    if (!out_[from].emplace(to, 1).second) {
+      return false;
+    }
+    in_[to].emplace(from, 1);
+    return true;
+  }
+  // @return : false if there was no such edge.
+  bool remove_edge(int from, int to) {
+    if (out_[from].erase(to) == 0) {
+      return false;
+    }
+    in_[to].erase(from);
+    return true;
+  }
+  // Removes every edge from or to v. O(degree)
+  void remove_node(int v) {
+    for (const auto &[to, _] : out_[v]) {
+      in_[to].erase(v);
+    }
+    for (const auto &[from, _] : in_[v]) {
+      out_[from].erase(v);
+    }
+    out_[v].clear();
+    in_[v].clear();
+  }
+  void reserve_row(int v, size_t n) { out_[v].reserve(n); }
+};
 
 inline bool add_edge(SparseMatrix &mat, int from, int to) {
-  return mat[from].emplace(to, 1).second;
+  return mat.add_edge(from, to);
 }
 
 inline bool remove_edge(SparseMatrix &mat, const Edge &e) {
-  return mat[e.first].erase(e.second) == 1;
+  return mat.remove_edge(e.first, e.second);
 }
 
 // O(1)
@@ -24,25 +70,126 @@ inline uint32_t get_out_degree(const SparseMatrix &mat, int point) {
   return mat[point].size();
 }
 
-// O(n)
+// O(1)
 inline uint32_t get_in_degree(const SparseMatrix &mat, int point) {
-  uint32_t count = 0;
-  for (const auto &row : mat) {
-    // For an unordered_map, find() is O(1) on avg.
-    if (row.find(point) != row.end()) {
-      count++;
+  return mat.in(point).size();
+}
+
+inline CSRGraph to_csr(const SparseMatrix &mat, bool with_transpose = true) {
+  CSRBuilder builder(mat.size());
+  for (int i = 0; i < mat.size(); i++) {
+    for (const auto &kv : mat[i]) {
+      builder.add_edge(i, kv.first);
+    }
+  }
+  return builder.build(with_transpose);
+}
+
+inline SparseMatrix to_sparse_matrix(const CSRGraph &g) {
+  SparseMatrix mat(g.size());
+  for (int i = 0; i < g.size(); i++) {
+    mat.reserve_row(i, g.out_degree(i));
+    for (const int j : g.out(i)) {
+      mat.add_edge(i, j);
     }
   }
-  return count;
+  return mat;
 }
 
 extern bool loop_based_line_graph_gen;
+// Rank line graphs implicitly from the original SCC instead of building them.
+extern bool implicit_line_graph_page_rank;
+// page_rank_fas removes from an SCC per round the edges ranked within
+// fas_batch_tolerance of the top (0 = ties only), at most fas_batch_size of
+// them (0 = no cap).
+extern int fas_batch_size;
+extern float fas_batch_tolerance;
+// Threads page_rank_fas uses to process SCCs, <= 0 = all hardware threads.
+extern int fas_threads;
+// Start each round's PageRank from the ranks of the previous round instead of
+// the uniform vector, optionally settling them by local residual pushes.
+extern bool fas_warm_start;
+extern bool fas_residual_push;
+
+enum class PageRankSolver {
+  // Power iteration, every sweep reads only the previous vector.
+  JACOBI,
+  // In-place sweeps that already use the ranks updated in the same sweep.
+  // Runs on one thread.
+  GAUSS_SEIDEL,
+  // Power iteration with periodic quadratic extrapolation (Kamvar et al.),
+  // which cancels the slowest decaying components of the error.
+  EXTRAPOLATION,
+};
+// How page_rank_fas runs PageRank: solver, iteration limit and L1 tolerance.
+extern PageRankSolver fas_page_rank_solver;
+extern int fas_max_iter;
+extern float fas_stop_error;
+// Early exit of page_rank_fas PageRank runs once the top fas_batch_size edges
+// stop moving, see page_rank_options_t::stable_iterations. 0 = off.
+extern int fas_stable_iterations;
+extern float fas_stable_gap;
+// page_rank_fas solves SCCs of up to this many vertices (at most 20) exactly
+// instead of by PageRank, removing all their feedback arcs at once. 0 = off,
+// as in the paper.
+extern int fas_exact_size;
+
+// Work page_rank_fas spent in PageRank during its last call.
+struct page_rank_fas_stats_t {
+  // PageRank runs, one per SCC per round.
+  long runs = 0;
+  // Sweeps summed over all runs, and the most any single run needed.
+  long iterations = 0;
+  int max_iterations = 0;
+  // Runs that stopped on the tolerance rather than on the iteration limit.
+  long converged = 0;
+  // Runs that stopped early because the top ranked edges settled.
+  long stable = 0;
+  // SCCs solved exactly instead, see fas_exact_size.
+  long exact = 0;
+};
+extern page_rank_fas_stats_t page_rank_fas_stats;
+
+// Run sort_fas from several starting orders (identity, greedy_fas_optimized's
+// order, descending d_out - d_in) on up to fas_threads threads and keep the
+// smallest FAS.
+extern bool sort_fas_multi_start;
 
 using FAS = std::vector<Edge>;
-using fas_solver = std::function<FAS(const SparseMatrix &)>;
-FAS sort_fas(const SparseMatrix &mat);
-FAS greedy_fas(const SparseMatrix &mat);
-FAS greedy_fas_optimized(const SparseMatrix &mat);
-FAS page_rank_fas(const SparseMatrix &mat);
+using fas_solver = std::function<FAS(const CSRGraph &)>;
+FAS sort_fas(const CSRGraph &mat);
+FAS greedy_fas(const CSRGraph &mat);
+FAS greedy_fas_optimized(const CSRGraph &mat);
+FAS page_rank_fas(const CSRGraph &mat);
+
+// The order of vertices greedy_fas_optimized ends up with.
+std::vector<int> greedy_order(const CSRGraph &mat);
+// Edges that point backward in a vertex order, i.e. the FAS it stands for.
+FAS backward_edges(const CSRGraph &mat, const std::vector<int> &order);
+
+enum class FasStatus {
+  VALID,
+  // An edge of the FAS is not in the graph.
+  MISSING_EDGE,
+  // An edge of the FAS is listed more than once.
+  DUPLICATE_EDGE,
+  // The graph without the FAS still has a cycle.
+  CYCLIC,
+};
+// A message for printing.
+const char *describe(FasStatus status);
+// Checks that fas is a feedback arc set of mat by removing it and running a
+// topological sort, level by level in parallel on big graphs. O(n + m) plus
+// a binary search per FAS edge.
+// @param n_threads : <= 0 means one per hardware thread.
+FasStatus validate_fas(const CSRGraph &mat, const FAS &fas, int n_threads = 0);
+
+// Solver names test_bench -s and benchmark -s take, in a fixed order.
+std::vector<std::string> solver_names();
+// Looks up a solver by name and sets the globals that pick its variant
+// (loop_based_line_graph_gen, implicit_line_graph_page_rank and
+// sort_fas_multi_start).
+// @return : false if there is no such solver.
+bool select_solver(const std::string &name, fas_solver &solver);
 
 void print_ans(const FAS &fas);
@@ -0,0 +1,174 @@
+#include "csr_graph.h"
+
+#include <algorithm>
+
+CSRGraph::CSRGraph(int n, std::vector<size_t> offsets,
+                   std::vector<int> neighbors, bool with_transpose)
+    : n_(n), own_offsets_(std::move(offsets)),
+      own_neighbors_(std::move(neighbors)) {
+  attach();
+  if (with_transpose) {
+    build_transpose();
+  }
+}
+
+CSRGraph::CSRGraph(int n, std::vector<size_t> offsets,
+                   std::vector<int> neighbors, std::vector<size_t> in_offsets,
+                   std::vector<int> in_neighbors)
+    : n_(n), own_offsets_(std::move(offsets)),
+      own_neighbors_(std::move(neighbors)),
+      own_in_offsets_(std::move(in_offsets)),
+      own_in_neighbors_(std::move(in_neighbors)) {
+  attach();
+}
+
+CSRGraph CSRGraph::view(int n, Span<size_t> offsets, Span<int> neighbors,
+                        Span<size_t> in_offsets, Span<int> in_neighbors,
+                        std::shared_ptr<const void> backing,
+                        bool with_transpose) {
+  CSRGraph g;
+  g.n_ = n;
+  g.offsets_ = offsets;
+  g.neighbors_ = neighbors;
+  g.in_offsets_ = in_offsets;
+  g.in_neighbors_ = in_neighbors;
+  g.backing_ = std::move(backing);
+  if (with_transpose && !g.has_transpose()) {
+    g.build_transpose();
+  }
+  return g;
+}
+
+CSRGraph::CSRGraph(const CSRGraph &other)
+    : n_(other.n_), offsets_(other.offsets_), neighbors_(other.neighbors_),
+      in_offsets_(other.in_offsets_), in_neighbors_(other.in_neighbors_),
+      own_offsets_(other.own_offsets_), own_neighbors_(other.own_neighbors_),
+      own_in_offsets_(other.own_in_offsets_),
+      own_in_neighbors_(other.own_in_neighbors_), backing_(other.backing_) {
+  attach();
+}
+
+// Moving a vector keeps its buffer, so the spans stay valid.
+CSRGraph::CSRGraph(CSRGraph &&other) noexcept : CSRGraph() {
+  swap(*this, other);
+}
+
+CSRGraph &CSRGraph::operator=(CSRGraph other) noexcept {
+  swap(*this, other);
+  return *this;
+}
+
+void swap(CSRGraph &a, CSRGraph &b) noexcept {
+  using std::swap;
+  swap(a.n_, b.n_);
+  swap(a.offsets_, b.offsets_);
+  swap(a.neighbors_, b.neighbors_);
+  swap(a.in_offsets_, b.in_offsets_);
+  swap(a.in_neighbors_, b.in_neighbors_);
+  swap(a.own_offsets_, b.own_offsets_);
+  swap(a.own_neighbors_, b.own_neighbors_);
+  swap(a.own_in_offsets_, b.own_in_offsets_);
+  swap(a.own_in_neighbors_, b.own_in_neighbors_);
+  swap(a.backing_, b.backing_);
+}
+
+void CSRGraph::attach() {
+  if (!own_offsets_.empty()) {
+    offsets_ = {own_offsets_.data(), own_offsets_.size()};
+  }
+  if (!own_neighbors_.empty()) {
+    neighbors_ = {own_neighbors_.data(), own_neighbors_.size()};
+  }
+  if (!own_in_offsets_.empty()) {
+    in_offsets_ = {own_in_offsets_.data(), own_in_offsets_.size()};
+  }
+  if (!own_in_neighbors_.empty()) {
+    in_neighbors_ = {own_in_neighbors_.data(), own_in_neighbors_.size()};
+  }
+}
+
+// Counting sort by destination. Since rows are scanned in ascending order,
+// every transposed row comes out sorted as well.
+void CSRGraph::build_transpose() {
+  std::vector<size_t> &in_offsets = own_in_offsets_;
+  std::vector<int> &in_neighbors = own_in_neighbors_;
+  in_offsets.assign(n_ + 1, 0);
+  for (const int to : neighbors_) {
+    in_offsets[to + 1]++;
+  }
+  for (int v = 0; v < n_; v++) {
+    in_offsets[v + 1] += in_offsets[v];
+  }
+  in_neighbors.resize(neighbors_.size());
+  std::vector<size_t> pos(in_offsets.begin(), in_offsets.end() - 1);
+  for (int from = 0; from < n_; from++) {
+    for (const int to : out(from)) {
+      in_neighbors[pos[to]++] = from;
+    }
+  }
+  attach();
+}
+
+uint32_t CSRGraph::in_degree(int v) const {
+  if (has_transpose()) {
+    return in_offsets_[v + 1] - in_offsets_[v];
+  }
+  return std::count(neighbors_.begin(), neighbors_.end(), v);
+}
+
+bool CSRGraph::has_edge(int from, int to) const {
+  const Range row = out(from);
+  return std::binary_search(row.begin(), row.end(), to);
+}
+
+int64_t CSRGraph::edge_position(int from, int to) const {
+  const Range row = out(from);
+  const int *it = std::lower_bound(row.begin(), row.end(), to);
+  if (it == row.end() || *it != to) {
+    return -1;
+  }
+  return it - neighbors_.data();
+}
+
+Edge CSRGraph::edge_at(size_t pos) const {
+  // The source is the last vertex whose row starts at or before pos.
+  auto it = std::upper_bound(offsets_.begin(), offsets_.end(), pos);
+  return {static_cast<int>(it - offsets_.begin()) - 1, neighbors_[pos]};
+}
+
+CSRGraph CSRBuilder::build(bool with_transpose) {
+  std::vector<size_t> offsets(n_ + 1, 0);
+  for (const auto &[from, _] : edges_) {
+    offsets[from + 1]++;
+  }
+  for (int v = 0; v < n_; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<int> neighbors(edges_.size());
+  {
+    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+    for (const auto &[from, to] : edges_) {
+      neighbors[pos[from]++] = to;
+    }
+  }
+  // Release the edge list before sorting so peak memory stays ~1 copy.
+  std::vector<Edge>().swap(edges_);
+
+  // Sort each row and squeeze out duplicates in place.
+  size_t write = 0;
+  for (int v = 0; v < n_; v++) {
+    const size_t begin = offsets[v];
+    const size_t end = offsets[v + 1];
+    std::sort(neighbors.begin() + begin, neighbors.begin() + end);
+    offsets[v] = write;
+    for (size_t i = begin; i < end; i++) {
+      if (write == offsets[v] || neighbors[i] != neighbors[write - 1]) {
+        neighbors[write++] = neighbors[i];
+      }
+    }
+  }
+  offsets[n_] = write;
+  neighbors.resize(write);
+  neighbors.shrink_to_fit();
+  return {n_, std::move(offsets), std::move(neighbors), with_transpose};
+}
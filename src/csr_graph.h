@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using Edge = std::pair<int, int>;
+
+// A contiguous, read-only run of T, like std::span.
+template <typename T> class Span {
+  const T *begin_ = nullptr;
+  const T *end_ = nullptr;
+
+public:
+  Span() = default;
+  Span(const T *begin, const T *end) : begin_(begin), end_(end) {}
+  Span(const T *begin, size_t size) : begin_(begin), end_(begin + size) {}
+  const T *begin() const { return begin_; }
+  const T *end() const { return end_; }
+  const T *data() const { return begin_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+  const T &operator[](size_t i) const { return begin_[i]; }
+  const T &back() const { return end_[-1]; }
+};
+
+// Immutable compressed-sparse-row graph.
+// Out-neighbors of vertex v are neighbors[offsets[v] .. offsets[v + 1]) and are
+// sorted ascending, so the edge (v, neighbors[offsets[v] + k]) can be referred
+// to by its position offsets[v] + k. An optional transposed copy gives the
+// in-neighbors in the same layout.
+// The arrays are either owned or borrowed from memory kept alive by a shared
+// handle, e.g. a mapped graph file (see view()).
+class CSRGraph {
+public:
+  // A run of vertex ids.
+  using Range = Span<int>;
+
+  CSRGraph() = default;
+  // Build a graph of n vertices from arrays that already follow the layout.
+  CSRGraph(int n, std::vector<size_t> offsets, std::vector<int> neighbors,
+           bool with_transpose = true);
+  // Same, with the transposed arrays given as well.
+  CSRGraph(int n, std::vector<size_t> offsets, std::vector<int> neighbors,
+           std::vector<size_t> in_offsets, std::vector<int> in_neighbors);
+  // A graph over arrays owned by someone else, which stay valid as long as
+  // backing is alive. The transposed arrays may be empty, then they are built
+  // (and owned) if with_transpose is set.
+  static CSRGraph view(int n, Span<size_t> offsets, Span<int> neighbors,
+                       Span<size_t> in_offsets, Span<int> in_neighbors,
+                       std::shared_ptr<const void> backing,
+                       bool with_transpose = true);
+
+  CSRGraph(const CSRGraph &other);
+  CSRGraph(CSRGraph &&other) noexcept;
+  CSRGraph &operator=(CSRGraph other) noexcept;
+  friend void swap(CSRGraph &a, CSRGraph &b) noexcept;
+
+  int size() const { return n_; }
+  bool empty() const { return n_ == 0; }
+  size_t n_edges() const { return neighbors_.size(); }
+  bool has_transpose() const { return !in_offsets_.empty(); }
+
+  Range out(int v) const {
+    return {neighbors_.data() + offsets_[v],
+            neighbors_.data() + offsets_[v + 1]};
+  }
+  // Requires the transposed copy.
+  Range in(int v) const {
+    return {in_neighbors_.data() + in_offsets_[v],
+            in_neighbors_.data() + in_offsets_[v + 1]};
+  }
+
+  // O(1)
+  uint32_t out_degree(int v) const { return offsets_[v + 1] - offsets_[v]; }
+  // O(1) with the transposed copy, O(m) without.
+  uint32_t in_degree(int v) const;
+
+  // O(log(out_degree(from)))
+  bool has_edge(int from, int to) const;
+
+  // Position of edge (from, to) in the neighbor array, -1 if absent.
+  int64_t edge_position(int from, int to) const;
+
+  // The edge stored at position pos of the neighbor array. O(log(n))
+  Edge edge_at(size_t pos) const;
+
+  Span<size_t> offsets() const { return offsets_; }
+  Span<int> neighbors() const { return neighbors_; }
+  // Empty without the transposed copy.
+  Span<size_t> in_offsets() const { return in_offsets_; }
+  Span<int> in_neighbors() const { return in_neighbors_; }
+
+private:
+  void build_transpose();
+  // Points the spans at the owned arrays, where there are any.
+  void attach();
+
+  int n_ = 0;
+  Span<size_t> offsets_;
+  Span<int> neighbors_;
+  Span<size_t> in_offsets_;
+  Span<int> in_neighbors_;
+  // Storage of the spans above, empty where they are borrowed.
+  std::vector<size_t> own_offsets_;
+  std::vector<int> own_neighbors_;
+  std::vector<size_t> own_in_offsets_;
+  std::vector<int> own_in_neighbors_;
+  std::shared_ptr<const void> backing_;
+};
+
+// Collects edges and packs them into a CSRGraph with a count-then-fill pass.
+// Duplicated edges are merged.
+class CSRBuilder {
+  int n_;
+  std::vector<Edge> edges_;
+
+public:
+  explicit CSRBuilder(int n) : n_(n) {}
+  void reserve(size_t n_edges) { edges_.reserve(n_edges); }
+  void add_edge(int from, int to) { edges_.emplace_back(from, to); }
+  size_t n_added() const { return edges_.size(); }
+  CSRGraph build(bool with_transpose = true);
+};
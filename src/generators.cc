@@ -0,0 +1,130 @@
+#include "generators.h"
+
+#include "graph_io.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <numeric>
+
+using std::vector;
+
+namespace {
+
+// Draws per chunk, one chunk being one task with its own generator.
+constexpr int64_t DRAW_CHUNK = 1 << 20;
+
+// splitmix64 (Steele et al.). Unlike the std distributions it gives the same
+// numbers with every standard library.
+class Random {
+  uint64_t state_;
+
+public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+  // Uniform in [0, n), n > 0. The modulo bias is below n / 2^64.
+  uint64_t below(uint64_t n) { return next() % n; }
+  // Uniform in [0, 1)
+  double real() { return (next() >> 11) * 0x1.0p-53; }
+};
+
+// The splitmix64 output function on its own, a bijective 64-bit hash.
+uint64_t mix(uint64_t x) { return Random(x - 0x9e3779b97f4a7c15).next(); }
+
+// Independent stream number i of a seed. Seed and index are hashed apart
+// before they meet, so nearby (seed, i) pairs share no stream.
+Random stream(uint64_t seed, uint64_t i) {
+  return Random(mix(mix(seed) ^ mix(i + 1)));
+}
+
+// Fisher-Yates on stream 0.
+vector<int> random_permutation(int n, uint64_t seed) {
+  vector<int> perm(n);
+  std::iota(perm.begin(), perm.end(), 0);
+  Random random = stream(seed, 0);
+  for (int i = n - 1; i > 0; i--) {
+    std::swap(perm[i], perm[random.below(i + 1)]);
+  }
+  return perm;
+}
+
+// Two distinct vertices of [0, n), n >= 2.
+inline Edge distinct_pair(Random &random, int n) {
+  const int u = random.below(n);
+  int v = random.below(n - 1);
+  return {u, v >= u ? v + 1 : v};
+}
+
+// Makes draw i of [0, m) with draw(i, random, edge), chunk c using stream
+// c + 1, and packs the edges for which it returns true.
+template <class Draw>
+CSRGraph generate(int n, int64_t m, uint64_t seed, int n_threads,
+                  const Draw &draw) {
+  ThreadPool pool(n_threads);
+  const size_t n_chunks = (std::max<int64_t>(m, 0) + DRAW_CHUNK - 1) /
+                          DRAW_CHUNK;
+  vector<vector<Edge>> parts(n_chunks);
+  pool.parallel_for(n_chunks, [&](size_t c) {
+    Random random = stream(seed, c + 1);
+    const int64_t begin = c * DRAW_CHUNK;
+    const int64_t end = std::min(m, begin + DRAW_CHUNK);
+    parts[c].reserve(end - begin);
+    Edge edge;
+    for (int64_t i = begin; i < end; i++) {
+      if (draw(i, random, edge)) {
+        parts[c].push_back(edge);
+      }
+    }
+  });
+  return pack_edges(n, parts, pool);
+}
+
+} // namespace
+
+CSRGraph erdos_renyi_graph(int n, int64_t m, uint64_t seed, int n_threads) {
+  return generate(n, n < 2 ? 0 : m, seed, n_threads,
+                  [n](int64_t, Random &random, Edge &edge) {
+                    edge = distinct_pair(random, n);
+                    return true;
+                  });
+}
+
+CSRGraph rmat_graph(int scale, int64_t m, uint64_t seed, int n_threads) {
+  constexpr double A = 0.57, B = 0.19, C = 0.19;
+  const int n = 1 << scale;
+  const vector<int> perm = random_permutation(n, seed);
+  return generate(n, m, seed, n_threads,
+                  [&](int64_t, Random &random, Edge &edge) {
+                    int from = 0, to = 0;
+                    for (int level = 0; level < scale; level++) {
+                      const double r = random.real();
+                      // Quadrants a, b, c, d of the adjacency matrix.
+                      const bool lower = r >= A + B;
+                      const bool right = (r >= A && !lower) || r >= A + B + C;
+                      from = from << 1 | lower;
+                      to = to << 1 | right;
+                    }
+                    edge = {perm[from], perm[to]};
+                    return from != to;
+                  });
+}
+
+CSRGraph planted_fas_graph(int n, int64_t m, int64_t back_edges, uint64_t seed,
+                           vector<int> &order, int n_threads) {
+  order = random_permutation(n, seed);
+  return generate(n, n < 2 ? 0 : m, seed, n_threads,
+                  [&](int64_t i, Random &random, Edge &edge) {
+                    // Positions in the order, the earlier one first.
+                    auto [p, q] = distinct_pair(random, n);
+                    if (p > q) {
+                      std::swap(p, q);
+                    }
+                    edge = i < back_edges ? Edge(order[q], order[p])
+                                          : Edge(order[p], order[q]);
+                    return true;
+                  });
+}
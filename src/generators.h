@@ -0,0 +1,26 @@
+#pragma once
+#include "csr_graph.h"
+#include <cstdint>
+#include <vector>
+
+// Random directed graphs for scaling experiments. Edges are drawn in fixed
+// size chunks, each with its own seeded generator, so a seed gives the same
+// graph on every machine and for any number of threads. Self-loops are never
+// drawn; duplicated draws are merged, so a graph can have fewer than m edges.
+// @param n_threads : <= 0 means one per hardware thread.
+
+// Erdős–Rényi G(n, m): m uniform draws of an edge between two distinct
+// vertices.
+CSRGraph erdos_renyi_graph(int n, int64_t m, uint64_t seed, int n_threads = 0);
+
+// R-MAT (Chakrabarti et al.) on 2^scale vertices with the Graph500
+// quadrant probabilities (0.57, 0.19, 0.19, 0.05), which gives power-law
+// degrees. Vertex ids are shuffled so the hubs aren't the low ids.
+CSRGraph rmat_graph(int scale, int64_t m, uint64_t seed, int n_threads = 0);
+
+// A DAG over a random vertex order, with the first back_edges of the m draws
+// turned to point backward in it. Those back edges are a FAS, so
+// backward_edges(g, order).size() <= back_edges bounds the minimum FAS.
+// @param order : set to the order the DAG follows.
+CSRGraph planted_fas_graph(int n, int64_t m, int64_t back_edges, uint64_t seed,
+                           std::vector<int> &order, int n_threads = 0);
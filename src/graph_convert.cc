@@ -0,0 +1,26 @@
+#include "graph_io.h"
+#include <cstdio>
+#include <string>
+
+// Converts a graph file (edge list or cache) into a graph cache, which
+// test_bench -i then loads without parsing.
+int main(int argc, const char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: %s <input_file> <output_file>\n", argv[0]);
+    return -1;
+  }
+  const std::string input = argv[1], output = argv[2];
+  CSRGraph graph;
+  if (const ReadStatus status = read_graph(input, graph);
+      status != ReadStatus::OK) {
+    printf("%s: '%s'\n", describe(status), input.c_str());
+    return -1;
+  }
+  if (!write_graph_cache(output, graph)) {
+    printf("Can't write '%s'\n", output.c_str());
+    return -1;
+  }
+  printf("Wrote %d vertices and %lu edges to '%s'\n", graph.size(),
+         graph.n_edges(), output.c_str());
+  return 0;
+}
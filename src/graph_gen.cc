@@ -0,0 +1,77 @@
+#include "common.h"
+#include "generators.h"
+#include "graph_io.h"
+#include "input_parser.h"
+#include <cstdio>
+#include <string>
+using std::string;
+
+// Writes a random graph as an edge list, or as a graph cache with -c.
+int main(int argc, const char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: %s <er|rmat|planted> <output_file> [-n vertices] "
+           "[-m edges] [-b back_edges] [-seed seed] [-j threads] [-c]\n",
+           argv[0]);
+    return -1;
+  }
+  const string model = argv[1], output = argv[2];
+  InputParser parser(argc, argv);
+  int n = 1000;
+  if (parser.option_exists("-n")) {
+    n = std::stoi(parser.get_option("-n"));
+  }
+  int64_t m = 8LL * n;
+  if (parser.option_exists("-m")) {
+    m = std::stoll(parser.get_option("-m"));
+  }
+  int64_t back_edges = m / 100;
+  if (parser.option_exists("-b")) {
+    back_edges = std::stoll(parser.get_option("-b"));
+  }
+  uint64_t seed = 1;
+  if (parser.option_exists("-seed")) {
+    seed = std::stoull(parser.get_option("-seed"));
+  }
+  int n_threads = 0;
+  if (parser.option_exists("-j")) {
+    n_threads = std::stoi(parser.get_option("-j"));
+  }
+  if (n <= 0 || n > (1 << 30) || m < 0) {
+    puts("Need 0 < vertices <= 2^30 and edges >= 0");
+    return -1;
+  }
+
+  CSRGraph graph;
+  std::vector<int> order;
+  if (model == "er") {
+    graph = erdos_renyi_graph(n, m, seed, n_threads);
+  } else if (model == "rmat") {
+    // Rounded up to a power of two.
+    int scale = 0;
+    while ((1 << scale) < n) {
+      scale++;
+    }
+    graph = rmat_graph(scale, m, seed, n_threads);
+  } else if (model == "planted") {
+    graph = planted_fas_graph(n, m, back_edges, seed, order, n_threads);
+  } else {
+    printf("Unknown model '%s'\n", model.c_str());
+    return -1;
+  }
+
+  const bool written = parser.option_exists("-c")
+                           ? write_graph_cache(output, graph)
+                           : write_edge_list(output, graph);
+  if (!written) {
+    printf("Can't write '%s'\n", output.c_str());
+    return -1;
+  }
+  printf("Wrote %d vertices and %lu edges to '%s'\n", graph.size(),
+         graph.n_edges(), output.c_str());
+  if (!order.empty()) {
+    const size_t planted = backward_edges(graph, order).size();
+    printf("Planted FAS = %lu (%.2f%%), an upper bound of the minimum FAS\n",
+           planted, planted * 100.0 / graph.n_edges());
+  }
+  return 0;
+}
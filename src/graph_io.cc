@@ -0,0 +1,443 @@
+#include "graph_io.h"
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::vector;
+
+const char *describe(ReadStatus status) {
+  switch (status) {
+  case ReadStatus::OK:
+    return "OK";
+  case ReadStatus::NOT_FOUND:
+    return "File doesn't exist";
+  case ReadStatus::BAD_SIZE:
+    return "Can't read graph size";
+  case ReadStatus::BAD_EDGE:
+    return "Input pattern mismatch";
+  case ReadStatus::BAD_FORMAT:
+    return "Unsupported or truncated graph cache";
+  }
+  return "Unknown error";
+}
+
+namespace {
+
+// Read-only view of a whole file, unmapped on destruction. Without mmap (MSVC)
+// the file is read into memory instead.
+class MappedFile {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  vector<char> buffer_;
+#endif
+
+public:
+  explicit MappedFile(const std::string &filename) {
+#ifdef _WIN32
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+      return;
+    }
+    char chunk[1 << 16];
+    size_t n_read;
+    while ((n_read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+      buffer_.insert(buffer_.end(), chunk, chunk + n_read);
+    }
+    fclose(file);
+    if (!buffer_.empty()) {
+      data_ = buffer_.data();
+      size_ = buffer_.size();
+    }
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(addr);
+        size_ = st.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+  ~MappedFile() {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool ok() const { return data_ != nullptr; }
+  size_t size() const { return size_; }
+  const char *begin() const { return data_; }
+  const char *end() const { return data_ + size_; }
+};
+
+// Bytes per chunk handed to one parsing task. Small enough to balance the
+// threads, large enough that the per-chunk edge vectors stay few.
+constexpr size_t PARSE_CHUNK = 1 << 20;
+
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Parses a non-negative decimal number below limit at p, advancing p.
+inline bool parse_vertex(const char *&p, const char *end, int64_t limit,
+                         int &value) {
+  if (p == end || !is_digit(*p)) {
+    return false;
+  }
+  int64_t x = 0;
+  for (; p != end && is_digit(*p); p++) {
+    x = x * 10 + (*p - '0');
+    if (x >= limit) {
+      return false;
+    }
+  }
+  value = x;
+  return true;
+}
+
+// Parses the edges of [p, end), which holds whole lines only.
+bool parse_edges(const char *p, const char *end, int n, vector<Edge> &edges) {
+  while (true) {
+    while (p != end && is_space(*p)) {
+      p++;
+    }
+    if (p == end) {
+      return true;
+    }
+    int from, to;
+    if (!parse_vertex(p, end, n, from)) {
+      return false;
+    }
+    int n_sep = 0;
+    for (; n_sep < 3 && p != end && (*p == ' ' || *p == ','); n_sep++) {
+      p++;
+    }
+    while (p != end && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (n_sep == 0 || !parse_vertex(p, end, n, to)) {
+      return false;
+    }
+    edges.emplace_back(from, to);
+  }
+}
+
+inline size_t align8(size_t bytes) { return (bytes + 7) & ~size_t(7); }
+
+// Bytes of the arrays of one direction of a graph.
+inline size_t arrays_size(uint64_t n, uint64_t n_edges) {
+  return (n + 1) * sizeof(size_t) + align8(n_edges * sizeof(int));
+}
+
+bool write_arrays(FILE *file, Span<size_t> offsets, Span<int> neighbors) {
+  static const char zeros[8] = {};
+  const size_t pad = align8(neighbors.size() * sizeof(int)) -
+                     neighbors.size() * sizeof(int);
+  return fwrite(offsets.data(), sizeof(size_t), offsets.size(), file) ==
+             offsets.size() &&
+         fwrite(neighbors.data(), sizeof(int), neighbors.size(), file) ==
+             neighbors.size() &&
+         fwrite(zeros, 1, pad, file) == pad;
+}
+
+} // namespace
+
+// Counts out degrees, places every edge in its row and then sorts and
+// deduplicates the rows.
+CSRGraph pack_edges(int n, const vector<vector<Edge>> &parts,
+                    ThreadPool &pool) {
+  vector<std::atomic<size_t>> cursor(n + 1);
+  pool.parallel_for(parts.size(), [&](size_t i) {
+    for (const auto &[from, _] : parts[i]) {
+      cursor[from + 1].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  vector<size_t> offsets(n + 1, 0);
+  for (int v = 0; v < n; v++) {
+    offsets[v + 1] = offsets[v] + cursor[v + 1].load();
+    cursor[v] = offsets[v];
+  }
+  vector<int> neighbors(offsets[n]);
+  pool.parallel_for(parts.size(), [&](size_t i) {
+    for (const auto &[from, to] : parts[i]) {
+      neighbors[cursor[from].fetch_add(1, std::memory_order_relaxed)] = to;
+    }
+  });
+  // Rows are filled in any order, sorting makes the result deterministic.
+  const size_t n_blocks = std::min<size_t>(n, pool.size() * 8);
+  vector<size_t> unique(n, 0);
+  pool.parallel_for(n_blocks, [&](size_t b) {
+    const int begin = n * b / n_blocks, end = n * (b + 1) / n_blocks;
+    for (int v = begin; v < end; v++) {
+      auto first = neighbors.begin() + offsets[v];
+      auto last = neighbors.begin() + offsets[v + 1];
+      std::sort(first, last);
+      unique[v] = std::unique(first, last) - first;
+    }
+  });
+  size_t write = 0;
+  for (int v = 0; v < n; v++) {
+    const size_t begin = offsets[v];
+    if (write != begin) {
+      std::copy(neighbors.begin() + begin,
+                neighbors.begin() + begin + unique[v],
+                neighbors.begin() + write);
+    }
+    offsets[v] = write;
+    write += unique[v];
+  }
+  offsets[n] = write;
+  neighbors.resize(write);
+  neighbors.shrink_to_fit();
+  return {n, std::move(offsets), std::move(neighbors)};
+}
+
+static ReadStatus parse_edge_list(const MappedFile &file, CSRGraph &graph,
+                                  int n_threads) {
+  const char *p = file.begin(), *end = file.end();
+  while (p != end && is_space(*p)) {
+    p++;
+  }
+  int n;
+  if (!parse_vertex(p, end, INT32_MAX, n) || n == 0) {
+    return ReadStatus::BAD_SIZE;
+  }
+
+  // Chunk boundaries are moved to the start of the next line.
+  vector<const char *> cuts{p};
+  while (static_cast<size_t>(end - cuts.back()) > PARSE_CHUNK) {
+    const char *cut = cuts.back() + PARSE_CHUNK;
+    cut = static_cast<const char *>(memchr(cut, '\n', end - cut));
+    if (cut == nullptr) {
+      break;
+    }
+    cuts.push_back(cut + 1);
+  }
+  cuts.push_back(end);
+
+  ThreadPool pool(n_threads);
+  const size_t n_chunks = cuts.size() - 1;
+  vector<vector<Edge>> parts(n_chunks);
+  std::atomic<bool> ok = true;
+  pool.parallel_for(n_chunks, [&](size_t i) {
+    // Edge lines take at least 4 bytes.
+    parts[i].reserve((cuts[i + 1] - cuts[i]) / 4);
+    if (!parse_edges(cuts[i], cuts[i + 1], n, parts[i])) {
+      ok = false;
+    }
+  });
+  if (!ok) {
+    return ReadStatus::BAD_EDGE;
+  }
+  graph = pack_edges(n, parts, pool);
+  return ReadStatus::OK;
+}
+
+ReadStatus read_edge_list(const std::string &filename, CSRGraph &graph,
+                          int n_threads) {
+  MappedFile file(filename);
+  if (!file.ok()) {
+    return ReadStatus::NOT_FOUND;
+  }
+  return parse_edge_list(file, graph, n_threads);
+}
+
+static_assert(sizeof(size_t) == sizeof(uint64_t) && sizeof(int) == 4,
+              "The graph cache stores the in-memory arrays as they are");
+static_assert(sizeof(graph_cache_header_t) % 8 == 0);
+
+bool write_edge_list(const std::string &filename, const CSRGraph &graph) {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  // printf per edge is the bottleneck on big graphs, so format by hand.
+  vector<char> buffer;
+  buffer.reserve(1 << 16);
+  char digits[12];
+  const auto append = [&](int64_t x, char end) {
+    int k = 0;
+    do {
+      digits[k++] = '0' + x % 10;
+      x /= 10;
+    } while (x > 0);
+    while (k > 0) {
+      buffer.push_back(digits[--k]);
+    }
+    buffer.push_back(end);
+  };
+  const auto flush = [&]() {
+    const bool ok =
+        fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    buffer.clear();
+    return ok;
+  };
+  bool ok = true;
+  append(graph.size(), '\n');
+  for (int v = 0; v < graph.size() && ok; v++) {
+    for (const int w : graph.out(v)) {
+      append(v, ' ');
+      append(w, '\n');
+    }
+    if (buffer.size() >= (1 << 16)) {
+      ok = flush();
+    }
+  }
+  ok = ok && flush();
+  return fclose(file) == 0 && ok;
+}
+
+bool write_graph_cache(const std::string &filename, const CSRGraph &graph) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  graph_cache_header_t header{};
+  std::copy(std::begin(GRAPH_CACHE_MAGIC), std::end(GRAPH_CACHE_MAGIC),
+            header.magic);
+  header.version = GRAPH_CACHE_VERSION;
+  header.flags = graph.has_transpose() ? GRAPH_CACHE_HAS_TRANSPOSE : 0;
+  header.n = graph.size();
+  header.n_edges = graph.n_edges();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            write_arrays(file, graph.offsets(), graph.neighbors());
+  if (ok && graph.has_transpose()) {
+    ok = write_arrays(file, graph.in_offsets(), graph.in_neighbors());
+  }
+  return fclose(file) == 0 && ok;
+}
+
+static bool is_graph_cache(const MappedFile &file) {
+  return file.size() >= sizeof(GRAPH_CACHE_MAGIC) &&
+         std::equal(std::begin(GRAPH_CACHE_MAGIC), std::end(GRAPH_CACHE_MAGIC),
+                    file.begin());
+}
+
+static ReadStatus map_graph_cache(std::shared_ptr<MappedFile> file,
+                                  CSRGraph &graph) {
+  graph_cache_header_t header;
+  if (!is_graph_cache(*file) || file->size() < sizeof(header)) {
+    return ReadStatus::BAD_FORMAT;
+  }
+  std::copy(file->begin(), file->begin() + sizeof(header),
+            reinterpret_cast<char *>(&header));
+  const bool transposed = header.flags & GRAPH_CACHE_HAS_TRANSPOSE;
+  const uint64_t n = header.n, m = header.n_edges;
+  if (header.version != GRAPH_CACHE_VERSION || n == 0 || n > INT32_MAX ||
+      file->size() !=
+          sizeof(header) + arrays_size(n, m) * (transposed ? 2 : 1)) {
+    return ReadStatus::BAD_FORMAT;
+  }
+  // mmap returns page aligned memory, and every part is 8-byte aligned.
+  const char *p = file->begin() + sizeof(header);
+  auto arrays = [&](Span<size_t> &offsets, Span<int> &neighbors) {
+    offsets = {reinterpret_cast<const size_t *>(p), n + 1};
+    neighbors = {reinterpret_cast<const int *>(p + (n + 1) * sizeof(size_t)),
+                 m};
+    p += arrays_size(n, m);
+    // One pass so a corrupt file can't send the solvers out of bounds.
+    if (offsets[0] != 0 || offsets[n] != m) {
+      return false;
+    }
+    for (uint64_t v = 0; v < n; v++) {
+      if (offsets[v] > offsets[v + 1]) {
+        return false;
+      }
+    }
+    if (!std::all_of(neighbors.begin(), neighbors.end(), [n](int w) {
+          return w >= 0 && static_cast<uint64_t>(w) < n;
+        })) {
+      return false;
+    }
+    // has_edge and edge_at search the rows, so they must be strictly
+    // ascending, as CSRBuilder leaves them.
+    for (uint64_t v = 0; v < n; v++) {
+      for (size_t k = offsets[v] + 1; k < offsets[v + 1]; k++) {
+        if (neighbors[k - 1] >= neighbors[k]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+  Span<size_t> offsets, in_offsets;
+  Span<int> neighbors, in_neighbors;
+  if (!arrays(offsets, neighbors) ||
+      (transposed && !arrays(in_offsets, in_neighbors))) {
+    return ReadStatus::BAD_FORMAT;
+  }
+  if (transposed) {
+    // The transposed rows must be exactly the ones build_transpose makes:
+    // scanning the rows in order fills every in-row front to back.
+    vector<size_t> next(in_offsets.begin(), in_offsets.end() - 1);
+    for (uint64_t v = 0; v < n; v++) {
+      for (size_t k = offsets[v]; k < offsets[v + 1]; k++) {
+        const int w = neighbors[k];
+        if (next[w] == in_offsets[w + 1] ||
+            in_neighbors[next[w]++] != static_cast<int>(v)) {
+          return ReadStatus::BAD_FORMAT;
+        }
+      }
+    }
+  }
+  graph = CSRGraph::view(n, offsets, neighbors, in_offsets, in_neighbors,
+                         std::move(file));
+  return ReadStatus::OK;
+}
+
+ReadStatus read_graph_cache(const std::string &filename, CSRGraph &graph) {
+  auto file = std::make_shared<MappedFile>(filename);
+  if (!file->ok()) {
+    return ReadStatus::NOT_FOUND;
+  }
+  return map_graph_cache(std::move(file), graph);
+}
+
+ReadStatus read_graph(const std::string &filename, CSRGraph &graph,
+                      int n_threads) {
+  auto file = std::make_shared<MappedFile>(filename);
+  if (!file->ok()) {
+    return ReadStatus::NOT_FOUND;
+  }
+  if (is_graph_cache(*file)) {
+    return map_graph_cache(std::move(file), graph);
+  }
+  return parse_edge_list(*file, graph, n_threads);
+}
+
+CSRGraph example_graph() {
+  CSRBuilder builder(7);
+  builder.add_edge(0, 1);
+  builder.add_edge(1, 2);
+  builder.add_edge(2, 3);
+  builder.add_edge(3, 0);
+  builder.add_edge(3, 1);
+  builder.add_edge(4, 5);
+  builder.add_edge(5, 6);
+  builder.add_edge(6, 4);
+  return builder.build();
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "csr_graph.h"
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Outcome of reading a graph file.
+enum class ReadStatus {
+  OK,
+  // The file can't be opened or mapped.
+  NOT_FOUND,
+  // The leading vertex count is missing or not a positive number.
+  BAD_SIZE,
+  // A line isn't "<from><sep><to>", or names a vertex out of range.
+  BAD_EDGE,
+  // A graph cache of another version, truncated, or with arrays that don't
+  // form a graph: decreasing offsets, neighbors out of range, unsorted rows
+  // or a transposed copy that doesn't match.
+  BAD_FORMAT,
+};
+
+// A message for printing, e.g. "Input pattern mismatch".
+const char *describe(ReadStatus status);
+
+// Reads an edge list: the vertex count, then one edge per line as
+// "<from><sep><to>", sep being 1 to 3 spaces or commas (so both "1 2" and
+// "1,2" work). Duplicated edges are merged.
+// The file is memory-mapped, cut into line-aligned chunks that are parsed in
+// parallel, and packed into CSR form with a count-then-fill pass. The result
+// doesn't depend on the number of threads.
+// @param n_threads : threads to parse with, <= 0 means one per hardware thread.
+ReadStatus read_edge_list(const std::string &filename, CSRGraph &graph,
+                          int n_threads = 0);
+
+// Builds a graph on n vertices from edge lists filled in parallel, merging
+// duplicates. The result doesn't depend on how the edges are split up.
+CSRGraph pack_edges(int n, const std::vector<std::vector<Edge>> &parts,
+                    ThreadPool &pool);
+
+// Writes graph in the format read_edge_list reads, one "<from> <to>" line
+// per edge. @return : false if the file can't be written.
+bool write_edge_list(const std::string &filename, const CSRGraph &graph);
+
+// Graph cache: a binary file holding the CSR arrays as they are in memory, so
+// loading it is a mmap. Layout, in native byte order, every part 8-byte
+// aligned:
+//   graph_cache_header_t
+//   offsets[n + 1] (uint64), neighbors[n_edges] (int32)
+//   in_offsets[n + 1], in_neighbors[n_edges]   if HAS_TRANSPOSE is set
+struct graph_cache_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t n;
+  uint64_t n_edges;
+};
+constexpr char GRAPH_CACHE_MAGIC[8] = {'P', 'R', 'F', 'A', 'S', 'C', 'S', 'R'};
+// Bumped whenever the layout changes.
+constexpr uint32_t GRAPH_CACHE_VERSION = 1;
+// graph_cache_header_t::flags
+constexpr uint32_t GRAPH_CACHE_HAS_TRANSPOSE = 1;
+
+// Writes graph as a cache file, with its transposed copy if it has one.
+// @return : false if the file can't be written.
+bool write_graph_cache(const std::string &filename, const CSRGraph &graph);
+
+// Maps a cache file. The graph borrows the mapping, which stays alive as long
+// as the graph or a copy of it does. The transposed copy is built if the file
+// has none. The arrays are checked once in O(n + m) before use.
+ReadStatus read_graph_cache(const std::string &filename, CSRGraph &graph);
+
+// Reads a cache file or an edge list, telling them apart by the magic.
+ReadStatus read_graph(const std::string &filename, CSRGraph &graph,
+                      int n_threads = 0);
+
+// The standard example from TA's PPT: 7 vertices, 8 edges in two SCCs.
+CSRGraph example_graph();
@@ -1,28 +1,66 @@
 #include "common.h"
+#include "trace.h"
+#include <algorithm>
 #include <climits>
 #include <cstdio>
 #include <list>
-#include <unordered_set>
+#include <vector>
 
 namespace gfas {
-using GreedyGraph = std::unordered_map<int, SparseVec>;
+// The graph the naive greedy shrinks. Live vertices and their out-neighbors
+// are in a hash map, in-neighbors are kept next to it, so both degrees are
+// O(1) and removing a vertex is O(degree).
+class GreedyGraph {
+  std::unordered_map<int, SparseVec> out_;
+  std::vector<SparseVec> in_;
 
-uint32_t get_out_degree(const GreedyGraph &g, int point) {
-  int d = -1;
-  if (auto it = g.find(point); it != g.end()) {
-    d = it->second.size();
+public:
+  explicit GreedyGraph(const CSRGraph &mat) : in_(mat.size()) {
+    for (int i = 0; i < mat.size(); ++i) {
+      SparseVec &row = out_[i];
+      for (const int j : mat.out(i)) {
+        row.emplace(j, 1);
+        in_[j].emplace(i, 1);
+      }
+    }
   }
-  return d;
-}
 
-uint32_t get_in_degree(const GreedyGraph &g, int point) {
-  uint32_t count = 0;
-  for (const auto &[_, neighbors] : g) {
-    if (neighbors.find(point) != neighbors.end()) {
-      count++;
+  bool empty() const { return out_.empty(); }
+  // Live vertices with their out-neighbors
+  auto begin() const { return out_.begin(); }
+  auto end() const { return out_.end(); }
+
+  // -1 if point was removed.
+  uint32_t out_degree(int point) const {
+    auto it = out_.find(point);
+    return it == out_.end() ? -1 : it->second.size();
+  }
+  uint32_t in_degree(int point) const { return in_[point].size(); }
+
+  void remove_node(int point) {
+    auto it = out_.find(point);
+    if (it == out_.end()) { // No such point in graph
+      return;
+    }
+    for (const auto &[to, _] : it->second) {
+      in_[to].erase(point);
     }
+    for (const auto &[from, _] : in_[point]) {
+      if (from != point) {
+        out_[from].erase(point);
+      }
+    }
+    in_[point].clear();
+    out_.erase(it);
   }
-  return count;
+};
+
+uint32_t get_out_degree(const GreedyGraph &g, int point) {
+  return g.out_degree(point);
+}
+
+uint32_t get_in_degree(const GreedyGraph &g, int point) {
+  return g.in_degree(point);
 }
 
 using Predicate = std::function<uint32_t(const GreedyGraph &, int)>;
@@ -37,159 +75,150 @@ int get_target_node(const GreedyGraph &g, const Predicate &pred) {
   return target;
 }
 
-void remove_node(GreedyGraph &g, int point) {
-  if (g.find(point) == g.end()) { // No such point in graph
-    return;
-  }
-  // O(n^2)
-  for (auto &[from, neighbors] : g) {
-    if (from == point) {
-      continue;
-    }
-    neighbors.erase(point);
-  }
-  g.erase(point);
-}
-
-FAS merge_s1s2(const SparseMatrix &mat, const std::vector<int> &s1,
+FAS merge_s1s2(const CSRGraph &mat, const std::vector<int> &s1,
                const std::list<int> &s2) {
   FAS ret;
-  // Record visited nodes
-  std::unordered_set<int> set;
+  // Record visited nodes. A node counts as visited for its own edges, so
+  // self-loops are backward too.
+  std::vector<bool> visited(mat.size(), false);
   for (const int point : s1) {
-    for (const auto &[neighbor, _] : mat[point]) {
-      if (set.find(neighbor) != set.end()) {
+    visited[point] = true;
+    for (const int neighbor : mat.out(point)) {
+      if (visited[neighbor]) {
         ret.emplace_back(point, neighbor);
       }
     }
-    set.insert(point);
   }
   for (const int point : s2) {
-    for (const auto &[neighbor, _] : mat[point]) {
-      if (set.find(neighbor) != set.end()) {
+    visited[point] = true;
+    for (const int neighbor : mat.out(point)) {
+      if (visited[neighbor]) {
         ret.emplace_back(point, neighbor);
       }
     }
-    set.insert(point);
   }
   return ret;
 }
 
 namespace optimized {
+// Eades-Lin-Smyth bookkeeping in O(n + m) overall. Every live vertex sits in
+// one bucket: sinks, sources, or the others by delta = d_out - d_in. Buckets
+// are intrusive doubly linked lists over vertex ids, newest first.
 struct greedy_t {
-  using node_list_t = std::list<int>;
-  explicit greedy_t(const SparseMatrix &mat)
-      : mat_(mat), n_(mat.size()), node_refs_(n_), node_classes_(2 * n_ - 3),
-        node_class_indices_(n_) {
-    for (int i = 0; i < n_; ++i) {
-      uint32_t d_in = ::get_in_degree(mat, i);
-      uint32_t d_out = ::get_out_degree(mat, i);
-      int ref_idx = get_ref_idx(n_, d_out, d_in);
-      node_class_indices_[i] = ref_idx;
-      node_classes_[ref_idx].push_front(i);
-      node_refs_[i] = node_classes_[ref_idx].begin();
-      nodes_.insert(i);
-    }
-  }
+  static constexpr int SINKS = 0;
+  static constexpr int SOURCES = 1;
+  static constexpr int NIL = -1;
 
-  static int get_ref_idx(int n, uint32_t d_out, uint32_t d_in) {
-    if (d_out == 0) {
-      return 0;
+  explicit greedy_t(const CSRGraph &mat)
+      : mat_(mat.has_transpose() ? mat : transposed_), n_(mat.size()),
+        n_live_(n_), d_in_(n_), d_out_(n_), bucket_(n_), next_(n_, NIL),
+        prev_(n_, NIL), heads_(2 * n_ + 1, NIL), removed_(n_, false) {
+    if (!mat.has_transpose()) {
+      transposed_ = CSRGraph(n_, {mat.offsets().begin(), mat.offsets().end()},
+                             {mat.neighbors().begin(), mat.neighbors().end()});
     }
-    if (d_in == 0 && d_out > 0) {
-      // There are (2n - 3) refs in total
-      return 2 * n - 4;
+    max_delta_ = SOURCES;
+    for (int i = 0; i < n_; ++i) {
+      d_in_[i] = mat_.in_degree(i);
+      d_out_[i] = mat_.out_degree(i);
+      push(i);
     }
-    int delta = d_out - d_in;
-    return delta + n - 2;
   }
 
-  int size() const { return nodes_.size(); }
-  bool empty() const { return nodes_.empty(); }
+  bool empty() const { return n_live_ == 0; }
 
-  int get_node_class(int point) const {
-    return nodes_.find(point) == nodes_.end() ? -1 : node_class_indices_[point];
-  }
+  int get_sink_node() const { return heads_[SINKS]; }
 
-  int get_sink_node() const {
-    auto sink_nodes = node_classes_[0];
-    return sink_nodes.empty() ? -1 : *sink_nodes.begin();
-  }
+  int get_source_node() const { return heads_[SOURCES]; }
 
-  int get_source_node() const {
-    auto source_nodes = node_classes_[2 * n_ - 4];
-    return source_nodes.empty() ? -1 : *source_nodes.begin();
+  // A vertex of the largest delta. Amortized O(1): the pointer only moves up
+  // when a vertex gains delta, which happens at most once per edge.
+  int get_delta_node() {
+    while (max_delta_ > SOURCES && heads_[max_delta_] == NIL) {
+      max_delta_--;
+    }
+    return max_delta_ > SOURCES ? heads_[max_delta_] : NIL;
   }
 
-  int get_delta_node() const {
-    if (nodes_.empty()) {
-      return -1;
+  // O(d_in + d_out)
+  void remove_node(int point) {
+    unlink(point);
+    removed_[point] = true;
+    n_live_--;
+    for (const int neighbor : mat_.out(point)) {
+      if (!removed_[neighbor]) {
+        unlink(neighbor);
+        d_in_[neighbor]--;
+        push(neighbor);
+      }
     }
-    int ret;
-    // Loop in the desacending order of delta = d_out - d_in
-    for (int i = 2 * n_ - 5; i > 0; --i) {
-      if (!node_classes_[i].empty()) {
-        ret = *node_classes_[i].begin();
-        break;
+    for (const int neighbor : mat_.in(point)) {
+      if (!removed_[neighbor]) {
+        unlink(neighbor);
+        d_out_[neighbor]--;
+        push(neighbor);
       }
     }
-    return ret;
   }
 
-  // O(n)
-  void remove_node(int point) {
-    // Delete out edges
-    for (const auto &[neighbor, _] : mat_[point]) {
-      // If there is an edge from pont to neighbor
-      if (nodes_.find(neighbor) != nodes_.end()) {
-        int delta = get_node_class(neighbor);
-        node_classes_[delta].erase(node_refs_[neighbor]);
-        node_classes_[delta + 1].push_front(neighbor);
-        node_refs_[neighbor] = node_classes_[delta + 1].begin();
-        node_class_indices_[neighbor] = delta + 1;
-      }
+private:
+  int bucket_of(int point) const {
+    if (d_out_[point] == 0) {
+      return SINKS;
     }
-    // Delete in edges
-    for (int i = 0; i < n_; ++i) {
-      // Skip the point itself and nodes that have been removed
-      if (i == point || (nodes_.find(i) == nodes_.end())) {
-        continue;
-      }
-      // If there is an edge from i to point
-      if (const auto &neighbors = mat_[i];
-          neighbors.find(point) != neighbors.end()) {
-        int delta = get_node_class(i);
-        node_classes_[delta].erase(node_refs_[i]);
-        node_classes_[delta - 1].push_front(i);
-        node_refs_[i] = node_classes_[delta - 1].begin();
-        node_class_indices_[i] = delta - 1;
-      }
+    if (d_in_[point] == 0) {
+      return SOURCES;
     }
-    int d = get_node_class(point);
-    node_classes_[d].erase(node_refs_[point]);
-    nodes_.erase(point);
+    // delta is within [1 - n, n - 1]
+    return 2 + static_cast<int>(d_out_[point] - d_in_[point]) + n_ - 1;
   }
 
+  void push(int point) {
+    const int b = bucket_of(point);
+    bucket_[point] = b;
+    prev_[point] = NIL;
+    next_[point] = heads_[b];
+    if (heads_[b] != NIL) {
+      prev_[heads_[b]] = point;
+    }
+    heads_[b] = point;
+    max_delta_ = std::max(max_delta_, b);
+  }
+
+  void unlink(int point) {
+    if (prev_[point] != NIL) {
+      next_[prev_[point]] = next_[point];
+    } else {
+      heads_[bucket_[point]] = next_[point];
+    }
+    if (next_[point] != NIL) {
+      prev_[next_[point]] = prev_[point];
+    }
+  }
+
+  // Only set if mat comes without in-neighbors.
+  CSRGraph transposed_;
+  const CSRGraph &mat_;
   int n_;
-  const SparseMatrix &mat_;
-  // Store reference to each node in one of class lists
-  std::vector<node_list_t::iterator> node_refs_;
-  // delta = d_out - d_in for each node
-  std::vector<int> node_class_indices_;
-  // The node classes
-  std::vector<node_list_t> node_classes_;
-  std::unordered_set<int> nodes_;
+  int n_live_;
+  std::vector<uint32_t> d_in_;
+  std::vector<uint32_t> d_out_;
+  std::vector<int> bucket_;
+  std::vector<int> next_;
+  std::vector<int> prev_;
+  std::vector<int> heads_;
+  std::vector<bool> removed_;
+  // No delta bucket above this one is occupied.
+  int max_delta_;
 };
 
 }; // namespace optimized
 }; // namespace gfas
 
-FAS greedy_fas(const SparseMatrix &mat) {
+FAS greedy_fas(const CSRGraph &mat) {
+  TraceScope scope("greedy_naive");
   // Build graph from mat
-  gfas::GreedyGraph graph;
-  for (int i = 0; i < mat.size(); ++i) {
-    graph[i] = mat[i];
-  }
+  gfas::GreedyGraph graph(mat);
   std::vector<int> s1;
   std::list<int> s2;
   while (!graph.empty()) {
@@ -197,12 +226,12 @@ FAS greedy_fas(const SparseMatrix &mat) {
     // Find sources
     while ((target = gfas::get_target_node(graph, gfas::get_in_degree)) != -1) {
       s1.push_back(target);
-      gfas::remove_node(graph, target);
+      graph.remove_node(target);
     }
     while ((target = gfas::get_target_node(graph, gfas::get_out_degree)) !=
            -1) {
       s2.push_front(target);
-      gfas::remove_node(graph, target);
+      graph.remove_node(target);
     }
     int d_max = INT_MIN;
     for (const auto &[point, _] : graph) {
@@ -215,22 +244,23 @@ FAS greedy_fas(const SparseMatrix &mat) {
     }
     if (!graph.empty()) {
       s1.push_back(target);
-      gfas::remove_node(graph, target);
+      graph.remove_node(target);
     }
   }
   return gfas::merge_s1s2(mat, s1, s2);
 }
 
-FAS greedy_fas_optimized(const SparseMatrix &mat) {
+std::vector<int> greedy_order(const CSRGraph &mat) {
+  TraceScope scope("greedy_order");
   gfas::optimized::greedy_t greedy{mat};
 
   std::vector<int> s1;
-  std::list<int> s2;
-  // O(n^2)
+  std::vector<int> s2;
+  // O(n + m)
   while (!greedy.empty()) {
     int target;
     while ((target = greedy.get_sink_node()) != -1) {
-      s2.push_front(target);
+      s2.push_back(target);
       greedy.remove_node(target);
     }
     while ((target = greedy.get_source_node()) != -1) {
@@ -243,5 +273,11 @@ FAS greedy_fas_optimized(const SparseMatrix &mat) {
       greedy.remove_node(target);
     }
   }
-  return gfas::merge_s1s2(mat, s1, s2);
-}
\ No newline at end of file
+  // Sinks were found last to first.
+  s1.insert(s1.end(), s2.rbegin(), s2.rend());
+  return s1;
+}
+
+FAS greedy_fas_optimized(const CSRGraph &mat) {
+  return backward_edges(mat, greedy_order(mat));
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <climits>
+#include <string>
+#include <vector>
+
+// Command line flags of the tools, e.g. "-i graph.txt".
+class InputParser {
+public:
+  InputParser(int argc, const char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+      this->tokens_.emplace_back(argv[i]);
+    }
+  }
+  /// @author iain
+  const std::string &get_option(const std::string &option) const {
+    std::vector<std::string>::const_iterator itr;
+    itr = std::find(this->tokens_.begin(), this->tokens_.end(), option);
+    if (itr != this->tokens_.end() && ++itr != this->tokens_.end()) {
+      return *itr;
+    }
+    static const std::string empty_string;
+    return empty_string;
+  }
+  /// @author iain
+  bool option_exists(const std::string &option) const {
+    return std::find(this->tokens_.begin(), this->tokens_.end(), option) !=
+           this->tokens_.end();
+  }
+
+  // Reads the integer after option into value, which keeps its default if
+  // the option is absent. @return false if the option isn't a whole int.
+  bool get_int(const std::string &option, int &value) const {
+    if (!option_exists(option)) {
+      return true;
+    }
+    const std::string &text = get_option(option);
+    char *end = nullptr;
+    errno = 0;
+    const long parsed = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno == ERANGE ||
+        parsed < INT_MIN || parsed > INT_MAX) {
+      return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+  }
+
+private:
+  std::vector<std::string> tokens_;
+};
@@ -1,12 +1,16 @@
 #include "page_rank.h"
 
 #include "common.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <numeric>
 #include <stdexcept>
-#include <type_traits>
 #include <unordered_set>
 
 namespace prfas {
@@ -15,64 +19,409 @@ namespace prfas {
  * Section 1: PageRank computation
  ********************************** */
 
-// PageRank iteration step: vec = vec * mat
-inline RankVec operator*(const RankVec &vec, const SparseMatrix &mat) {
-  RankVec res(vec.size(), 0);
-  for (int i = 0; i < mat.size(); i++) {
-    for (const auto &kv : mat[i]) {
-      res[kv.first] += vec[i] / get_out_degree(mat, i);
+// Rows handled by one task of the kernel. Fixed, so the per-chunk error sums
+// (and the stopping iteration) don't depend on the number of threads.
+constexpr int ROW_CHUNK = 4096;
+
+// Sweeps between two quadratic extrapolations.
+constexpr int EXTRAPOLATION_PERIOD = 10;
+
+static void record(const page_rank_options_t &options, int iterations,
+                   float error, bool stable = false) {
+  if (options.stats != nullptr) {
+    options.stats->iterations = iterations;
+    options.stats->error = error;
+    options.stats->converged = error <= options.stop_error;
+    options.stats->stable = stable;
+  }
+}
+
+// Watches the order of the highest scores over the sweeps of a run, for the
+// stable_iterations and stable_gap stopping rules. The score of v is rank[v],
+// times scale[v] if given. Ties go to the lower index, as in page_rank_fas.
+struct top_tracker_t {
+  const page_rank_options_t &options;
+  const RankVec *scale;
+  // The stable_top best indices after the last sweep, best first.
+  vector<int> top;
+  // Sweeps since top last changed.
+  int unchanged = 0;
+
+  bool enabled() const {
+    return options.stable_iterations > 0 || options.stable_gap > 0;
+  }
+
+  // @return : whether the run may stop after this sweep.
+  bool update(const RankVec &rank) {
+    const size_t k = std::max(1, options.stable_top);
+    // The k + 1 best (score, index), to also know the gap below the k-th.
+    vector<std::pair<float, int>> best;
+    best.reserve(k + 2);
+    for (int v = 0; v < static_cast<int>(rank.size()); v++) {
+      const float score = scale == nullptr ? rank[v] : rank[v] * (*scale)[v];
+      if (best.size() > k && score <= best.back().first) {
+        continue;
+      }
+      auto it = best.end();
+      while (it != best.begin() && (it - 1)->first < score) {
+        --it;
+      }
+      best.insert(it, {score, v});
+      if (best.size() > k + 1) {
+        best.pop_back();
+      }
+    }
+    vector<int> current;
+    for (size_t i = 0; i < best.size() && i < k; i++) {
+      current.push_back(best[i].second);
+    }
+    if (current == top) {
+      unchanged++;
+    } else {
+      top.swap(current);
+      unchanged = 0;
+    }
+    if (options.stable_iterations > 0 &&
+        unchanged >= options.stable_iterations) {
+      return true;
+    }
+    if (options.stable_gap <= 0 || unchanged == 0) {
+      return false;
+    }
+    if (best.size() <= k) {
+      return true; // Everything is in the top
+    }
+    const float kth = best[k - 1].first, next = best[k].first;
+    return kth > 0 && kth - next > options.stable_gap * kth;
+  }
+};
+
+// Quadratic extrapolation (Kamvar et al., "Extrapolation Methods for
+// Accelerating PageRank Computations"). Assumes the iterates x0..x3 are mixes
+// of the 3 leading eigenvectors, fits the coefficients that cancel the 2nd and
+// 3rd by least squares, and writes the estimate of the 1st into x3, keeping its
+// sum. Left alone when the fit is degenerate.
+static void quadratic_extrapolation(const RankVec &x0, const RankVec &x1,
+                                    const RankVec &x2, RankVec &x3) {
+  double a11 = 0, a12 = 0, a22 = 0, b1 = 0, b2 = 0, sum = 0;
+  for (size_t v = 0; v < x3.size(); v++) {
+    const double y1 = x1[v] - x0[v], y2 = x2[v] - x0[v], y3 = x3[v] - x0[v];
+    a11 += y1 * y1;
+    a12 += y1 * y2;
+    a22 += y2 * y2;
+    b1 -= y1 * y3;
+    b2 -= y2 * y3;
+    sum += x3[v];
+  }
+  const double det = a11 * a22 - a12 * a12;
+  if (std::fabs(det) <= 1e-12 * a11 * a22 || det == 0) {
+    return;
+  }
+  const double gamma1 = (b1 * a22 - b2 * a12) / det;
+  const double gamma2 = (a11 * b2 - a12 * b1) / det;
+  const double beta0 = gamma1 + gamma2 + 1, beta1 = gamma2 + 1;
+  double new_sum = 0;
+  for (size_t v = 0; v < x3.size(); v++) {
+    x3[v] = std::max(0.0, beta0 * x1[v] + beta1 * x2[v] + x3[v]);
+    new_sum += x3[v];
+  }
+  if (new_sum > 0) {
+    for (float &x : x3) {
+      x *= sum / new_sum;
     }
   }
-  return res;
 }
 
-template <class T>
-inline RankVec operator+(const RankVec &vec, const T val) {
-  static_assert(std::is_arithmetic<T>::value, "Class T has to be numeric");
-  RankVec res(vec);
-  for (float &elem : res) {
-    elem += val;
+// Fused pull-style power iteration over the transposed graph:
+//   rank'[v] = sum(rank[u] * weight[u] for u in in(v)) + teleport[v]
+// Two buffers pairs (rank, share = rank * weight) are swapped every step, and
+// the L1 error is summed in the same pass. Rows are split into chunks across
+// the pool without atomics, since every row is written by exactly one task.
+static RankVec pull_iterate(const CSRGraph &g, const RankVec &weight,
+                            const RankVec &teleport, RankVec rank,
+                            const page_rank_options_t &options,
+                            const RankVec *scale) {
+  const int size = g.size();
+  const size_t n_chunks = (size + ROW_CHUNK - 1) / ROW_CHUNK;
+  RankVec rank_new(size), share(size), share_new(size);
+  vector<float> chunk_error(n_chunks);
+  const bool extrapolate = options.solver == PageRankSolver::EXTRAPOLATION;
+  // The last 3 iterates before the current one, oldest first.
+  vector<RankVec> history(extrapolate ? 3 : 0);
+  for (int v = 0; v < size; v++) {
+    share[v] = rank[v] * weight[v];
   }
-  return res;
+  auto step = [&](size_t c) {
+    const int begin = c * ROW_CHUNK;
+    const int end = std::min(size, begin + ROW_CHUNK);
+    float error = 0;
+    for (int v = begin; v < end; v++) {
+      float sum = 0;
+      const CSRGraph::Range in = g.in(v);
+      const int *src = in.begin();
+      const uint32_t degree = in.size();
+#pragma omp simd reduction(+ : sum)
+      for (uint32_t k = 0; k < degree; k++) {
+        sum += share[src[k]];
+      }
+      const float r = sum + teleport[v];
+      error += std::fabs(r - rank[v]);
+      rank_new[v] = r;
+      share_new[v] = r * weight[v];
+    }
+    chunk_error[c] = error;
+  };
+  top_tracker_t tracker{options, scale, {}};
+  bool stable = false;
+  float error = options.stop_error + 1;
+  int i = 0;
+  for (; i < options.max_iter && error > options.stop_error && !stable; i++) {
+    if (extrapolate) {
+      std::rotate(history.begin(), history.begin() + 1, history.end());
+      history.back() = rank;
+    }
+    if (options.pool != nullptr) {
+      options.pool->parallel_for(n_chunks, step);
+    } else {
+      for (size_t c = 0; c < n_chunks; c++) {
+        step(c);
+      }
+    }
+    error = 0;
+    for (const float e : chunk_error) {
+      error += e;
+    }
+    rank.swap(rank_new);
+    share.swap(share_new);
+    if (extrapolate && i >= 3 && (i + 1) % EXTRAPOLATION_PERIOD == 0 &&
+        error > options.stop_error) {
+      quadratic_extrapolation(history[0], history[1], history[2], rank);
+      for (int v = 0; v < size; v++) {
+        share[v] = rank[v] * weight[v];
+      }
+    }
+    stable = tracker.enabled() && tracker.update(rank);
+  }
+  record(options, i, error, stable);
+  return rank;
+}
+
+// In-place sweeps in vertex order, each row already reading the ranks updated
+// earlier in the same sweep. Without teleport (beta = 1) the system only fixes
+// the direction of the vector, so it is rescaled to its old sum every sweep.
+static RankVec gauss_seidel(const CSRGraph &g, const RankVec &weight,
+                            const RankVec &teleport, RankVec rank,
+                            const page_rank_options_t &options,
+                            const RankVec *scale) {
+  const int size = g.size();
+  const bool rescale = options.beta == 1;
+  RankVec share(size), prev;
+  double sum = 0;
+  for (int v = 0; v < size; v++) {
+    share[v] = rank[v] * weight[v];
+    sum += rank[v];
+  }
+  top_tracker_t tracker{options, scale, {}};
+  bool stable = false;
+  float error = options.stop_error + 1;
+  int i = 0;
+  for (; i < options.max_iter && error > options.stop_error && !stable; i++) {
+    prev = rank;
+    double new_sum = 0;
+    for (int v = 0; v < size; v++) {
+      float r = teleport[v];
+      for (const int u : g.in(v)) {
+        r += share[u];
+      }
+      rank[v] = r;
+      share[v] = r * weight[v];
+      new_sum += r;
+    }
+    if (rescale && new_sum > 0) {
+      const float scale = sum / new_sum;
+      for (int v = 0; v < size; v++) {
+        rank[v] *= scale;
+        share[v] *= scale;
+      }
+    }
+    error = 0;
+    for (int v = 0; v < size; v++) {
+      error += std::fabs(rank[v] - prev[v]);
+    }
+    stable = tracker.enabled() && tracker.update(rank);
+  }
+  record(options, i, error, stable);
+  return rank;
+}
+
+// Settles the residual r = rank' - rank of the same system by local pushes:
+// moving r[v] into rank[v] adds r[v] * weight[v] to the residual of every out
+// neighbor of v. Only vertices whose residual exceeds stop_error / size are
+// queued, so after a small change of the graph mostly its neighborhood is
+// touched. Gives up once it has done about max_iter sweeps worth of pushes.
+// @return : whether the total residual got below stop_error.
+static bool push_residual(const CSRGraph &g, const RankVec &weight,
+                          const RankVec &teleport, RankVec &rank,
+                          const page_rank_options_t &options) {
+  const int size = g.size();
+  const float threshold = options.stop_error / size;
+  RankVec residual(size);
+  // FIFO of vertices to push, each queued at most once, so size slots suffice.
+  vector<int> queue(size);
+  vector<char> queued(size, 0);
+  int head = 0, n_queued = 0;
+  auto enqueue = [&](int v) {
+    queued[v] = 1;
+    queue[(head + n_queued++) % size] = v;
+  };
+  for (int v = 0; v < size; v++) {
+    float sum = teleport[v];
+    for (const int u : g.in(v)) {
+      sum += rank[u] * weight[u];
+    }
+    residual[v] = sum - rank[v];
+    if (std::fabs(residual[v]) > threshold) {
+      enqueue(v);
+    }
+  }
+  int64_t budget = options.max_iter * static_cast<int64_t>(g.n_edges() + size);
+  while (n_queued > 0) {
+    if (budget <= 0) {
+      return false;
+    }
+    const int v = queue[head];
+    head = (head + 1) % size;
+    n_queued--;
+    queued[v] = 0;
+    const float r = residual[v];
+    rank[v] += r;
+    residual[v] = 0;
+    const float delta = r * weight[v];
+    for (const int w : g.out(v)) {
+      residual[w] += delta;
+      if (!queued[w] && std::fabs(residual[w]) > threshold) {
+        enqueue(w);
+      }
+    }
+    budget -= g.out_degree(v) + 1;
+  }
+  // 1 sweep for the initial residual, plus what the pushes are worth.
+  const int64_t sweep = g.n_edges() + size;
+  const int64_t pushed = options.max_iter * sweep - budget;
+  record(options, 1 + (pushed + sweep - 1) / sweep, 0);
+  return true;
 }
 
-template <class T>
-inline RankVec operator+(const T val, const RankVec &vec) {
-  return vec + val;
+// Rank vectors carried over from another graph lose the mass of removed parts.
+static void normalize(RankVec &rank) {
+  double sum = 0;
+  for (const float r : rank) {
+    sum += r;
+  }
+  if (sum <= 0) {
+    std::fill(rank.begin(), rank.end(), static_cast<float>(1) / rank.size());
+    return;
+  }
+  for (float &r : rank) {
+    r /= sum;
+  }
 }
 
-template <class T>
-inline RankVec operator*(const T val, const RankVec &vec) {
-  static_assert(std::is_arithmetic<T>::value, "Class T has to be numeric");
-  RankVec res(vec);
-  for (float &elem : res) {
-    elem *= val;
+// Runs the pull system from a uniform vector, or from a warm start that may
+// first be settled by residual pushes, with the chosen solver.
+// @param scale : what to multiply rank by to compare entries for the stable_*
+//                stopping rules, nullptr = compare rank itself.
+static RankVec solve(const CSRGraph &g, const RankVec &weight,
+                     const RankVec &teleport, RankVec rank, bool warm,
+                     const page_rank_options_t &options,
+                     const RankVec *scale = nullptr) {
+  TraceScope scope("page_rank");
+  scope.arg("vertices", g.size());
+  scope.arg("edges", g.n_edges());
+  const bool pushed = warm && options.residual_push &&
+                      push_residual(g, weight, teleport, rank, options);
+  if (!pushed && options.solver == PageRankSolver::GAUSS_SEIDEL) {
+    rank = gauss_seidel(g, weight, teleport, std::move(rank), options, scale);
+  } else if (!pushed) {
+    rank = pull_iterate(g, weight, teleport, std::move(rank), options, scale);
+  }
+  if (options.stats != nullptr) {
+    scope.arg("iterations", options.stats->iterations);
   }
-  return res;
+  return rank;
 }
 
-template <class T>
-inline RankVec operator*(const RankVec &vec, const T val) {
-  return val * vec;
+// The kernel pulls over in-neighbors, so make a transposed copy if needed.
+static const CSRGraph &with_transpose(const CSRGraph &g, CSRGraph &copy) {
+  if (g.has_transpose()) {
+    return g;
+  }
+  copy = CSRGraph(g.size(), {g.offsets().begin(), g.offsets().end()},
+                  {g.neighbors().begin(), g.neighbors().end()});
+  return copy;
 }
 
-inline float l1_error(const RankVec &v1, const RankVec &v2) {
-  float res = 0;
-  for (int i = 0; i < v1.size(); i++) {
-    res += std::fabs(v1[i] - v2[i]);
+RankVec page_rank(const CSRGraph &mat, const page_rank_options_t &options,
+                  RankVec init) {
+  CSRGraph copy;
+  const CSRGraph &g = with_transpose(mat, copy);
+  const auto size = g.size();
+  const float beta = options.beta;
+  RankVec weight(size), teleport(size, (1 - beta) / size);
+  for (int v = 0; v < size; v++) {
+    const uint32_t d_out = g.out_degree(v);
+    weight[v] = d_out == 0 ? 0 : beta / d_out;
+  }
+  const bool warm = !init.empty();
+  if (warm) {
+    normalize(init);
+  } else {
+    init.assign(size, static_cast<float>(1) / size);
   }
-  return res;
+  return solve(g, weight, teleport, std::move(init), warm, options);
 }
 
-RankVec page_rank(const SparseMatrix &mat, const float beta, const int max_iter,
-                  const float stop_error) {
-  const auto size = mat.size();
-  RankVec rank_new, rank(size, static_cast<float>(1) / size);
-  float error = stop_error + 1;
-  for (int i = 0; i < max_iter && error > stop_error; i++) {
-    rank_new = (beta * rank * mat) + (1 - beta) / size;
-    error = l1_error(rank_new, rank);
-    rank = rank_new;
+// Every out edge of v gets the same rank, the inflow of v split evenly. So
+// with t[v] = total rank on v's out edges, the line graph iteration becomes
+//   t'[v] = beta * sum(t[u] / out_degree(u) for u in in(v))
+//         + (1 - beta) * out_degree(v) / n_edges
+// which is a PageRank on G itself, teleporting in proportion to out degree.
+// Its L1 error equals the error over all edges of the line graph.
+RankVec line_graph_page_rank(const CSRGraph &G,
+                             const page_rank_options_t &options, RankVec init) {
+  CSRGraph copy;
+  const CSRGraph &g = with_transpose(G, copy);
+  const auto size = g.n_edges();
+  const float beta = options.beta;
+  const bool warm = !init.empty();
+  if (warm) {
+    normalize(init);
+  }
+  RankVec weight(g.size()), teleport(g.size()), total(g.size());
+  for (int v = 0; v < g.size(); v++) {
+    const size_t begin = g.offsets()[v], end = g.offsets()[v + 1];
+    const uint32_t d_out = end - begin;
+    weight[v] = d_out == 0 ? 0 : beta / d_out;
+    teleport[v] = (1 - beta) * d_out / size;
+    if (warm) {
+      total[v] = 0;
+      for (size_t e = begin; e < end; e++) {
+        total[v] += init[e];
+      }
+    } else {
+      total[v] = static_cast<float>(d_out) / size;
+    }
+  }
+  // The rank of each out edge of v is total[v] / out_degree(v), which is in
+  // proportion to total[v] * weight[v].
+  total = solve(g, weight, teleport, std::move(total), warm, options, &weight);
+  RankVec rank(size);
+  for (int v = 0; v < g.size(); v++) {
+    const size_t begin = g.offsets()[v], end = g.offsets()[v + 1];
+    if (begin != end) {
+      std::fill(rank.begin() + begin, rank.begin() + end,
+                total[v] / (end - begin));
+    }
   }
   return rank;
 }
@@ -81,61 +430,130 @@ RankVec page_rank(const SparseMatrix &mat, const float beta, const int max_iter,
  * Section 2: Line Graph Generation
  ********************************** */
 
-inline int find_or_add_edge_index(unordered_map<uint64_t, int> &index,
-                                  vector<Edge> &table, int from, int to) {
-  uint64_t code = encode_edge(from, to);
-  auto it = index.find(code);
-  if (it == index.end()) {
-    table[index.size()] = Edge(from, to);
-    it = index.emplace(code, index.size()).first;
+// Line graph vertices are the edges of G by CSR position, so edge (from, to)
+// at position k is vertex k and its successors are the whole row of to. That
+// sizes every row up front, and rows are filled independently in chunks of
+// ROW_CHUNK vertices.
+
+// Runs task(c) for every chunk c < n_chunks, on pool if there is one.
+static void for_chunks(ThreadPool *pool, size_t n_chunks,
+                       const std::function<void(size_t)> &task) {
+  if (pool != nullptr) {
+    pool->parallel_for(n_chunks, task);
+  } else {
+    for (size_t c = 0; c < n_chunks; c++) {
+      task(c);
+    }
   }
-  return it->second;
 }
 
-auto line_graph(const SparseMatrix &G) -> pair<SparseMatrix, vector<Edge>> {
-  int n_edges = 0;
-  for (const auto &row : G) {
-    n_edges += row.size();
+static vector<Edge> edge_table(const CSRGraph &G) {
+  vector<Edge> table(G.n_edges());
+  for (int v = 0; v < G.size(); v++) {
+    for (size_t k = G.offsets()[v]; k < G.offsets()[v + 1]; k++) {
+      table[k] = Edge(v, G.neighbors()[k]);
+    }
   }
-  if (!loop_based_line_graph_gen) {
-    return LineGraphGeneator(G, n_edges)();
+  return table;
+}
+
+// Row offsets of the line graph, the row of edge k being as long as the
+// row of its head, or of its tail's in-edges with transpose set.
+static vector<size_t> line_graph_offsets(const CSRGraph &G,
+                                         const vector<Edge> &table,
+                                         bool transpose, ThreadPool *pool) {
+  const size_t n_edges = table.size();
+  vector<size_t> offsets(n_edges + 1, 0);
+  for_chunks(pool, (n_edges + ROW_CHUNK - 1) / ROW_CHUNK, [&](size_t c) {
+    const size_t end = std::min(n_edges, (c + 1) * ROW_CHUNK);
+    for (size_t k = c * ROW_CHUNK; k < end; k++) {
+      offsets[k + 1] = transpose ? G.in_degree(table[k].first)
+                                 : G.out_degree(table[k].second);
+    }
+  });
+  for (size_t k = 0; k < n_edges; k++) {
+    offsets[k + 1] += offsets[k];
   }
-  SparseMatrix res(n_edges);
-  unordered_map<uint64_t, int> edge_index;
-  vector<Edge> edge_table(n_edges);
-  // DO NOT add 0 to visited!
-  for (int begin = 0; begin < G.size(); begin++) {
-    for (const auto &p : G[begin]) {
-      int mid = p.first;
-      int e_in = find_or_add_edge_index(edge_index, edge_table, begin, mid);
-      for (const auto &kv : G[mid]) {
-        int end = kv.first;
-        int e_curr = find_or_add_edge_index(edge_index, edge_table, mid, end);
-        res[e_in].emplace(e_curr, 1);
-        // printf("#(%d,%d)->#(%d,%d)\n", begin, mid, mid, end);
+  return offsets;
+}
+
+auto line_graph(const CSRGraph &G, ThreadPool *pool)
+    -> pair<CSRGraph, vector<Edge>> {
+  TraceScope scope("line_graph");
+  scope.arg("edges", G.n_edges());
+  CSRGraph copy;
+  const CSRGraph &g = with_transpose(G, copy);
+  vector<Edge> table = edge_table(g);
+  const size_t n_edges = table.size();
+  const size_t n_chunks = (n_edges + ROW_CHUNK - 1) / ROW_CHUNK;
+  const Span<size_t> g_offsets = g.offsets();
+
+  vector<size_t> offsets = line_graph_offsets(g, table, false, pool);
+  vector<int> neighbors(offsets.back());
+  if (!loop_based_line_graph_gen) {
+    LineGraphGeneator(g, offsets, neighbors)();
+  } else {
+    for_chunks(pool, n_chunks, [&](size_t c) {
+      const size_t end = std::min(n_edges, (c + 1) * ROW_CHUNK);
+      for (size_t e_in = c * ROW_CHUNK; e_in < end; e_in++) {
+        const int mid = table[e_in].second;
+        std::iota(neighbors.begin() + offsets[e_in],
+                  neighbors.begin() + offsets[e_in + 1], g_offsets[mid]);
       }
+    });
+  }
+
+  // The in-row of edge k lists the positions of the edges into its tail, in
+  // the order of g's transpose, which is ascending by position.
+  vector<size_t> in_pos(n_edges);
+  {
+    vector<size_t> cursor(g.in_offsets().begin(), g.in_offsets().end() - 1);
+    for (size_t k = 0; k < n_edges; k++) {
+      in_pos[cursor[table[k].second]++] = k;
+    }
+  }
+  vector<size_t> in_offsets = line_graph_offsets(g, table, true, pool);
+  vector<int> in_neighbors(in_offsets.back());
+  for_chunks(pool, n_chunks, [&](size_t c) {
+    const size_t end = std::min(n_edges, (c + 1) * ROW_CHUNK);
+    for (size_t e_out = c * ROW_CHUNK; e_out < end; e_out++) {
+      const int mid = table[e_out].first;
+      std::copy(in_pos.begin() + g.in_offsets()[mid],
+                in_pos.begin() + g.in_offsets()[mid + 1],
+                in_neighbors.begin() + in_offsets[e_out]);
+    }
+  });
+
+  CSRGraph lg(n_edges, std::move(offsets), std::move(neighbors),
+              std::move(in_offsets), std::move(in_neighbors));
+  scope.arg("line_graph_edges", lg.n_edges());
+  return {std::move(lg), std::move(table)};
+}
+
+void LineGraphGeneator::operator()() {
+  for (int v = 0; v < mat.size(); v++) {
+    if (!visited[v]) {
+      dfs_util(v, -1);
     }
   }
-  return {res, edge_table};
 }
 
 // NOTE: curr is point index, while e_prev is EDGE index!
 void LineGraphGeneator::dfs_util(const int curr, const int e_prev) {
   visited[curr] = true;
-  for (const auto &p : mat[curr]) {
-    int next = p.first;
-    int e_curr = find_or_add_edge_index(edge_index, edge_table, curr, next);
+  const Span<size_t> offsets = mat.offsets();
+  for (size_t e_curr = offsets[curr]; e_curr < offsets[curr + 1]; e_curr++) {
+    const int next = mat.neighbors()[e_curr];
     if (e_prev != -1) {
-      line_graph[e_prev].emplace(e_curr, 1);
+      neighbors[cursor[e_prev]++] = e_curr;
       // printf("%d->%d\n", e_prev, e_curr);
     }
     if (!visited[next]) {
       dfs_util(next, e_curr);
     } else {
-      for (const auto &p : mat[next]) {
-        int to = p.first;
-        int e_next = find_or_add_edge_index(edge_index, edge_table, next, to);
-        line_graph[e_curr].emplace(e_next, 1);
+      for (size_t e_next = offsets[next]; e_next < offsets[next + 1];
+           e_next++) {
+        neighbors[cursor[e_curr]++] = e_next;
         // printf("%d->%d\n", e_curr, e_next);
       }
     }
@@ -147,116 +565,532 @@ void LineGraphGeneator::dfs_util(const int curr, const int e_prev) {
  ********************************** */
 
 using std::min;
-using std::stack;
 using std::vector;
 
-// Recursive function to find the SCC using DFS traversal
-void SCC_Solver::scc_util(int u) {
-  // Initialize discovery time and low value
-  disc[u] = low[u] = ++time;
-  st.push(u);
-  stack_member[u] = true;
-
-  // Go through all vertices adjacent to this
-  for (auto i = mat[u].begin(); i != mat[u].end(); ++i) {
-    // v is current adjacent of 'u'
-    int v = i->first;
-
-    // If v is not visited yet, then recur for it
-    if (disc[v] == NIL) {
-      scc_util(v);
-
-      // Check if the subtree rooted with 'v' has connection to one of the
-      // ancestors of 'u'
-      low[u] = min(low[u], low[v]);
-    }
-
-    // Update low value of 'u' only of 'v' is still in stack
-    else if (stack_member[v]) {
-      low[u] = min(low[u], disc[v]);
-    }
-  }
-
-  // head node found, pop the stack and print an SCC
-
-  // Store stack extracted vertices
-  int w = 0;
-
-  // If low[u] and disc[u]
-  if (low[u] == disc[u]) {
-    vector<int> vertex_id;
-    std::unordered_map<int, int> reverse_id;
-    // When st top != u, the component has >1 vertices.
-    while (st.top() != u) {
-      w = st.top();
-      reverse_id[w] = vertex_id.size();
-      vertex_id.push_back(w);
-      // std::cout << w << " ";
-      stack_member[w] = false;
-      st.pop();
-    }
-    w = st.top();
-    if (!vertex_id.empty()) {
-      reverse_id[w] = vertex_id.size();
-      vertex_id.push_back(w);
-      SparseMatrix scc_mat(vertex_id.size());
-      for (int i = 0; i < vertex_id.size(); i++) {
-        for (auto kv : mat[vertex_id[i]]) {
-          if (reverse_id.find(kv.first) != reverse_id.end()) {
-            scc_mat[i].emplace(reverse_id[kv.first], 1);
-          }
-        }
+namespace {
+constexpr int NIL = -1;
+
+// Scratch arrays of SCC_Solver, grown to the largest graph seen on a thread.
+struct scc_workspace_t {
+  // Epoch of the call that discovered each vertex; older = not seen yet.
+  vector<uint32_t> seen;
+  // Discovery time, and the least discovery time reachable through the DFS
+  // subtree and one back edge.
+  vector<int> disc;
+  vector<int> low;
+  // Whether a vertex is on st. Every push is popped within the call.
+  vector<char> on_stack;
+  // Id inside the component being packed, NIL elsewhere.
+  vector<int> local;
+  // Vertices of the components still open, in discovery order.
+  vector<int> st;
+  // DFS path: a vertex and the position of its next edge to look at.
+  vector<std::pair<int, size_t>> frames;
+  uint32_t epoch = 0;
+
+  void prepare(int n) {
+    if (seen.size() < static_cast<size_t>(n)) {
+      seen.resize(n, 0);
+      disc.resize(n);
+      low.resize(n);
+      on_stack.resize(n, 0);
+      local.resize(n, NIL);
+    }
+    if (++epoch == 0) {
+      std::fill(seen.begin(), seen.end(), 0);
+      epoch = 1;
+    }
+  }
+};
+
+thread_local scc_workspace_t scc_workspace;
+
+// Copies the kept edges among vertex_id into a CSR of their own.
+// @param local : NIL for every vertex, and left that way.
+SCC pack(const CSRGraph &mat, const vector<bool> *removed,
+         vector<int> vertex_id, vector<int> &local) {
+  // Keep vertices in ascending order, so an SCC looks the same no matter
+  // which DFS found it. Rankings (and argmax ties) then don't depend on it.
+  // Rows then come out sorted too, local ids growing with global ones.
+  std::sort(vertex_id.begin(), vertex_id.end());
+  const int n = vertex_id.size();
+  for (int i = 0; i < n; i++) {
+    local[vertex_id[i]] = i;
+  }
+  vector<size_t> offsets(n + 1, 0);
+  vector<int> neighbors;
+  for (int i = 0; i < n; i++) {
+    const int v = vertex_id[i];
+    for (size_t pos = mat.offsets()[v]; pos < mat.offsets()[v + 1]; pos++) {
+      const int to = local[mat.neighbors()[pos]];
+      if (to != NIL && (removed == nullptr || !(*removed)[pos])) {
+        neighbors.push_back(to);
       }
-      result_scc.emplace_back(scc_mat, vertex_id);
     }
-    // std::cout << w << "\n";
-    stack_member[w] = false;
-    st.pop();
+    offsets[i + 1] = neighbors.size();
+  }
+  for (const int v : vertex_id) {
+    local[v] = NIL;
   }
+  return {CSRGraph(n, std::move(offsets), std::move(neighbors)),
+          std::move(vertex_id)};
 }
 
+} // namespace
+
 // Function to find the SCC in the graph
 auto SCC_Solver::operator()() -> const vector<SCC> & {
-  int v = mat.size();
-  time = 0;
-  // Clear last calculation's result
-  if (!result_scc.empty()) {
-    result_scc.clear();
+  TraceScope scope("scc");
+  scope.arg("vertices", mat.size());
+  scope.arg("edges", mat.n_edges());
+  const int n = mat.size();
+  const Span<size_t> offsets = mat.offsets();
+  const Span<int> neighbors = mat.neighbors();
+  scc_workspace_t &ws = scc_workspace;
+  ws.prepare(n);
+  result_scc.clear();
+  int time = 0;
+  const auto discover = [&](int v) {
+    ws.seen[v] = ws.epoch;
+    ws.disc[v] = ws.low[v] = ++time;
+    ws.st.push_back(v);
+    ws.on_stack[v] = true;
+    ws.frames.emplace_back(v, offsets[v]);
+  };
+
+  for (int root = 0; root < n; root++) {
+    if (ws.seen[root] == ws.epoch) {
+      continue;
+    }
+    discover(root);
+    while (!ws.frames.empty()) {
+      const int u = ws.frames.back().first;
+      size_t &pos = ws.frames.back().second;
+      if (pos < offsets[u + 1]) {
+        // Look at the next edge; discovering v pushes a frame, so pos is
+        // advanced first.
+        const size_t e = pos++;
+        const int v = neighbors[e];
+        if (!kept(e)) {
+          continue;
+        }
+        if (ws.seen[v] != ws.epoch) {
+          discover(v);
+        } else if (ws.on_stack[v]) {
+          ws.low[u] = min(ws.low[u], ws.disc[v]);
+        }
+        continue;
+      }
+      // All edges of u done: return to the parent.
+      ws.frames.pop_back();
+      if (!ws.frames.empty()) {
+        const int parent = ws.frames.back().first;
+        ws.low[parent] = min(ws.low[parent], ws.low[u]);
+      }
+      if (ws.low[u] != ws.disc[u]) {
+        continue;
+      }
+      // u is the head of a component: it and everything above it on st.
+      const auto first = std::find(ws.st.rbegin(), ws.st.rend(), u).base() - 1;
+      for (auto it = first; it != ws.st.end(); it++) {
+        ws.on_stack[*it] = false;
+      }
+      if (ws.st.end() - first > 1) {
+        result_scc.push_back(
+            pack(mat, removed, vector<int>(first, ws.st.end()), ws.local));
+      }
+      ws.st.erase(first, ws.st.end());
+    }
+  }
+
+  scope.arg("components", result_scc.size());
+  return result_scc;
+}
+
+void sort_by_first_vertex(vector<SCC> &sccs) {
+  std::sort(sccs.begin(), sccs.end(), [](const SCC &a, const SCC &b) {
+    return a.second[0] < b.second[0];
+  });
+}
+
+void remove_and_split(const SCC &scc, const std::vector<size_t> &pos,
+                      std::vector<SCC> &out) {
+  vector<bool> removed(scc.first.n_edges(), false);
+  for (const size_t e : pos) {
+    removed[e] = true;
+  }
+  SCC_Solver solver(scc.first, &removed);
+  solver();
+  for (SCC &child : solver.result_scc) {
+    // Child vertex ids are local to scc, map them back to the original graph.
+    for (int &v : child.second) {
+      v = scc.second[v];
+    }
+    out.push_back(std::move(child));
+  }
+}
+
+namespace {
+// Where a vertex stands in parallel_scc.
+enum class SccState : char {
+  // Not assigned yet.
+  OPEN,
+  // Has no in or no out edges among the open vertices, so is an SCC alone.
+  TRIMMED,
+  // In the SCC of the pivot.
+  PIVOT,
+};
+
+// Below this many items a step of parallel_scc runs on the calling thread.
+constexpr size_t SCC_GRAIN = 4096;
+
+// Runs task(block, begin, end) over [0, size) in blocks on the pool.
+template <class Task>
+void for_blocks(ThreadPool &pool, size_t size, const Task &task) {
+  const size_t n_blocks =
+      size < SCC_GRAIN ? 1
+                       : std::min<size_t>(size / SCC_GRAIN, pool.size() * 8);
+  const auto run = [&](size_t b) {
+    task(b, size * b / n_blocks, size * (b + 1) / n_blocks);
+  };
+  if (n_blocks == 1) {
+    run(0);
+  } else {
+    pool.parallel_for(n_blocks, run);
   }
+}
 
-  // Initialize disc and low, and stackMember arrays
-  for (int i = 0; i < v; i++) {
-    disc[i] = NIL;
-    low[i] = NIL;
-    stack_member[i] = false;
+// Level-synchronous search: calls visit(v, next) for every v of frontier,
+// which adds the vertices it claims to next, until nothing new is found.
+template <class Visit>
+void search(ThreadPool &pool, vector<int> frontier, const Visit &visit) {
+  vector<vector<int>> next;
+  vector<int> small;
+  while (!frontier.empty()) {
+    if (frontier.size() < SCC_GRAIN) {
+      // Long thin stretches, e.g. paths, stay cheap on one thread.
+      small.clear();
+      for (const int v : frontier) {
+        visit(v, small);
+      }
+      frontier.swap(small);
+      continue;
+    }
+    next.assign(pool.size() * 8, {});
+    for_blocks(pool, frontier.size(), [&](size_t b, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        visit(frontier[i], next[b]);
+      }
+    });
+    frontier.clear();
+    for (const vector<int> &found : next) {
+      frontier.insert(frontier.end(), found.begin(), found.end());
+    }
   }
+}
+
+struct scc_split_t {
+  const CSRGraph &g;
+  const vector<bool> *removed;
+  ThreadPool &pool;
+  vector<std::atomic<SccState>> state;
 
-  // Recursive helper function to find the SCC in DFS tree with vertex 'i'
-  for (int i = 0; i < v; i++) {
-    // If current node is not yet visited
-    if (disc[i] == NIL) {
-      scc_util(i);
+  scc_split_t(const CSRGraph &g, const vector<bool> *removed,
+              ThreadPool &pool)
+      : g(g), removed(removed), pool(pool), state(g.size()) {
+    for (auto &s : state) {
+      s.store(SccState::OPEN, std::memory_order_relaxed);
     }
   }
 
-  // Shouldn't happen, but just in case.
-  while (!st.empty()) {
-    st.pop();
+  bool open(int v) const {
+    return state[v].load(std::memory_order_relaxed) == SccState::OPEN;
+  }
+  bool kept(size_t pos) const {
+    return removed == nullptr || !(*removed)[pos];
+  }
+  // Only the out rows are indexed by the mask, so look in-edges up there.
+  bool kept_in(int from, int to) const {
+    return removed == nullptr || kept(g.edge_position(from, to));
+  }
+  template <class F> void for_out(int v, const F &f) const {
+    for (size_t pos = g.offsets()[v]; pos < g.offsets()[v + 1]; pos++) {
+      if (kept(pos)) {
+        f(g.neighbors()[pos]);
+      }
+    }
+  }
+  template <class F> void for_in(int v, const F &f) const {
+    for (const int u : g.in(v)) {
+      if (kept_in(u, v)) {
+        f(u);
+      }
+    }
   }
 
-  return result_scc;
+  // Peels off open vertices with no open in or no open out neighbor until
+  // none is left. @return : the open vertex with the largest
+  // in_degree * out_degree after the peel, NIL if none is open.
+  int trim() {
+    const int n = g.size();
+    vector<std::atomic<int>> in_degree(n), out_degree(n);
+    for_blocks(pool, n, [&](size_t, size_t begin, size_t end) {
+      for (size_t v = begin; v < end; v++) {
+        int d_out = 0;
+        if (open(v)) {
+          for_out(v, [&](int w) {
+            if (open(w)) {
+              d_out++;
+              in_degree[w].fetch_add(1, std::memory_order_relaxed);
+            }
+          });
+        }
+        out_degree[v].store(d_out, std::memory_order_relaxed);
+      }
+    });
+    vector<vector<int>> seeds(pool.size() * 8);
+    for_blocks(pool, n, [&](size_t b, size_t begin, size_t end) {
+      for (size_t v = begin; v < end; v++) {
+        if (open(v) && (in_degree[v] == 0 || out_degree[v] == 0)) {
+          state[v] = SccState::TRIMMED;
+          seeds[b].push_back(v);
+        }
+      }
+    });
+    vector<int> frontier;
+    for (const vector<int> &seed : seeds) {
+      frontier.insert(frontier.end(), seed.begin(), seed.end());
+    }
+    // A vertex is claimed by whoever moves it off OPEN, so it's queued once.
+    const auto claim = [this](int v, vector<int> &next) {
+      SccState expected = SccState::OPEN;
+      if (state[v].compare_exchange_strong(expected, SccState::TRIMMED)) {
+        next.push_back(v);
+      }
+    };
+    search(pool, std::move(frontier), [&](int v, vector<int> &next) {
+      for_out(v, [&](int w) {
+        if (open(w) && in_degree[w].fetch_sub(1) == 1) {
+          claim(w, next);
+        }
+      });
+      for_in(v, [&](int u) {
+        if (open(u) && out_degree[u].fetch_sub(1) == 1) {
+          claim(u, next);
+        }
+      });
+    });
+    int pivot = NIL;
+    int64_t best = 0;
+    for (int v = 0; v < n; v++) {
+      const int64_t product =
+          static_cast<int64_t>(in_degree[v]) * out_degree[v];
+      if (open(v) && product > best) {
+        pivot = v;
+        best = product;
+      }
+    }
+    return pivot;
+  }
+
+  // Marks the SCC of pivot: open vertices both reachable from it and
+  // reaching it.
+  void mark_pivot_scc(int pivot) {
+    const int n = g.size();
+    vector<std::atomic<char>> forward(n), backward(n);
+    for_blocks(pool, n, [&](size_t, size_t begin, size_t end) {
+      for (size_t v = begin; v < end; v++) {
+        forward[v].store(false, std::memory_order_relaxed);
+        backward[v].store(false, std::memory_order_relaxed);
+      }
+    });
+    forward[pivot] = backward[pivot] = true;
+    search(pool, {pivot}, [&](int v, vector<int> &next) {
+      for_out(v, [&](int w) {
+        if (open(w) && !forward[w].exchange(true)) {
+          next.push_back(w);
+        }
+      });
+    });
+    // Backward, but only through what the forward search reached.
+    search(pool, {pivot}, [&](int v, vector<int> &next) {
+      for_in(v, [&](int u) {
+        if (forward[u] && !backward[u].exchange(true)) {
+          next.push_back(u);
+        }
+      });
+    });
+    for_blocks(pool, n, [&](size_t, size_t begin, size_t end) {
+      for (size_t v = begin; v < end; v++) {
+        if (backward[v]) {
+          state[v].store(SccState::PIVOT, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+};
+} // namespace
+
+vector<SCC> parallel_scc(const CSRGraph &mat, ThreadPool &pool,
+                         const vector<bool> *removed) {
+  TraceScope scope("scc_parallel");
+  scope.arg("vertices", mat.size());
+  scope.arg("edges", mat.n_edges());
+  CSRGraph copy;
+  const CSRGraph &g = with_transpose(mat, copy);
+  scc_split_t split(g, removed, pool);
+  vector<SCC> result;
+  vector<int> local(g.size(), NIL);
+  if (const int pivot = split.trim(); pivot != NIL) {
+    split.mark_pivot_scc(pivot);
+    vector<int> members;
+    for (int v = 0; v < g.size(); v++) {
+      if (split.state[v] == SccState::PIVOT) {
+        members.push_back(v);
+      }
+    }
+    // A pivot with a cycle through it has more than itself in its SCC.
+    if (members.size() > 1) {
+      result.push_back(pack(g, removed, std::move(members), local));
+    }
+    split.trim();
+  }
+  // What is left is usually small, so Tarjan on a packed copy of it.
+  vector<int> rest;
+  for (int v = 0; v < g.size(); v++) {
+    if (split.open(v)) {
+      rest.push_back(v);
+    }
+  }
+  if (!rest.empty()) {
+    const SCC remainder = pack(g, removed, std::move(rest), local);
+    SCC_Solver solver(remainder.first);
+    solver();
+    for (SCC &child : solver.result_scc) {
+      for (int &v : child.second) {
+        v = remainder.second[v];
+      }
+      result.push_back(std::move(child));
+    }
+  }
+  sort_by_first_vertex(result);
+  scope.arg("components", result.size());
+  return result;
+}
+
+/* **********************************
+ * Section 4: Exact FAS of small graphs
+ ********************************** */
+
+// cost[S] is the fewest backward edges of any order of the vertex set S,
+// kept per thread since page_rank_fas calls this once per small SCC.
+static thread_local vector<uint16_t> exact_cost;
+
+// The edges of g pointing backward in an order where vertex v is at place[v].
+static vector<size_t> backward_positions(const CSRGraph &g, const int *place) {
+  vector<size_t> positions;
+  for (int v = 0; v < g.size(); v++) {
+    for (size_t k = g.offsets()[v]; k < g.offsets()[v + 1]; k++) {
+      if (place[g.neighbors()[k]] < place[v]) {
+        positions.push_back(k);
+      }
+    }
+  }
+  return positions;
+}
+
+// Two vertices: a 2-cycle loses the edge 0 -> 1, anything else is acyclic.
+static vector<size_t> exact_fas_2(const CSRGraph &g) {
+  if (g.has_edge(0, 1) && g.has_edge(1, 0)) {
+    return {g.offsets()[0]};
+  }
+  return {};
+}
+
+// Three vertices: the best of the 6 orders, first one on ties.
+static vector<size_t> exact_fas_3(const CSRGraph &g) {
+  static const int PLACES[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+                                   {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+  const int *best = nullptr;
+  int best_back = INT32_MAX;
+  for (const int *place : PLACES) {
+    int back = 0;
+    for (int v = 0; v < 3; v++) {
+      for (const int u : g.out(v)) {
+        back += place[u] < place[v];
+      }
+    }
+    if (back < best_back) {
+      best = place;
+      best_back = back;
+    }
+  }
+  return backward_positions(g, best);
+}
+
+vector<size_t> exact_fas(const CSRGraph &g) {
+  const int n = g.size();
+  if (n == 2) {
+    return exact_fas_2(g);
+  }
+  if (n == 3) {
+    return exact_fas_3(g);
+  }
+  vector<std::bitset<EXACT_FAS_MAX_SIZE>> out(n);
+  for (int v = 0; v < n; v++) {
+    for (const int u : g.out(v)) {
+      out[v].set(u);
+    }
+  }
+  // Placing v last in S costs its edges back into the rest of S.
+  const auto back_edges = [&](uint32_t rest, int v) {
+    return (out[v] & std::bitset<EXACT_FAS_MAX_SIZE>(rest)).count();
+  };
+  const uint32_t full = (1u << n) - 1;
+  vector<uint16_t> &cost = exact_cost;
+  cost.resize(size_t{1} << n);
+  cost[0] = 0;
+  for (uint32_t set = 1; set <= full; set++) {
+    size_t best = SIZE_MAX;
+    for (int v = 0; v < n; v++) {
+      if (set >> v & 1) {
+        const uint32_t rest = set & ~(1u << v);
+        best = std::min(best, cost[rest] + back_edges(rest, v));
+      }
+    }
+    cost[set] = best;
+  }
+  // Walk the table back from the full set, taking the lowest vertex that
+  // attains the optimum as the last one, and collect its backward edges.
+  vector<size_t> positions;
+  for (uint32_t set = full; set != 0;) {
+    int v = 0;
+    while (!(set >> v & 1) ||
+           cost[set & ~(1u << v)] + back_edges(set & ~(1u << v), v) !=
+               cost[set]) {
+      v++;
+    }
+    set &= ~(1u << v);
+    for (size_t k = g.offsets()[v]; k < g.offsets()[v + 1]; k++) {
+      if (set >> g.neighbors()[k] & 1) {
+        positions.push_back(k);
+      }
+    }
+  }
+  std::sort(positions.begin(), positions.end());
+  return positions;
 }
 
 }; // namespace prfas
 
 /* **********************************
- * Section 4: FAS algorithm
+ * Section 5: FAS algorithm
  ********************************** */
 
 inline int argmax(const prfas::RankVec &rank) {
   int index = 0;
   float max_r = 0;
-  for (int i = 0; i < rank.size(); i++) {
+  for (int i = 0; i < static_cast<int>(rank.size()); i++) {
     if (rank[i] > max_r) {
       index = i;
       max_r = rank[i];
@@ -266,40 +1100,256 @@ inline int argmax(const prfas::RankVec &rank) {
 };
 
 bool loop_based_line_graph_gen = false;
+bool implicit_line_graph_page_rank = false;
+int fas_batch_size = 1;
+float fas_batch_tolerance = 0;
+int fas_threads = 1;
+bool fas_warm_start = false;
+bool fas_residual_push = false;
+PageRankSolver fas_page_rank_solver = PageRankSolver::JACOBI;
+int fas_max_iter = 30;
+float fas_stop_error = 1e-5;
+int fas_stable_iterations = 0;
+float fas_stable_gap = 0;
+int fas_exact_size = 0;
+page_rank_fas_stats_t page_rank_fas_stats;
+
+// SCCs with at least this many edges are ranked one at a time with all
+// threads inside the PageRank kernel, instead of one thread per SCC.
+constexpr size_t PARALLEL_KERNEL_EDGES = 1 << 16;
 
 using std::vector;
-FAS page_rank_fas(const SparseMatrix &original_mat) {
+
+// Indices of the edges to remove in one round: those within
+// fas_batch_tolerance of the maximum, capped to the fas_batch_size highest.
+// Equal ranks go to the lower index, so a cap of 1 is exactly argmax.
+inline vector<int> top_ranked(const prfas::RankVec &rank) {
+  const int top = argmax(rank);
+  if (fas_batch_size == 1) {
+    return {top};
+  }
+  const float bound = rank[top] * (1 - fas_batch_tolerance);
+  vector<int> selected;
+  for (int i = 0; i < static_cast<int>(rank.size()); i++) {
+    if (rank[i] >= bound) {
+      selected.push_back(i);
+    }
+  }
+  auto higher = [&rank](int a, int b) {
+    return rank[a] > rank[b] || (rank[a] == rank[b] && a < b);
+  };
+  if (fas_batch_size > 0 &&
+      selected.size() > static_cast<size_t>(fas_batch_size)) {
+    std::nth_element(selected.begin(), selected.begin() + fas_batch_size,
+                     selected.end(), higher);
+    selected.resize(fas_batch_size);
+  }
+  return selected;
+}
+
+// Edge ranks carried from one round to the next, by CSR position in the input
+// graph. With implicit line graphs all out edges of a vertex rank the same, so
+// it is kept by input vertex instead. SCCs of a round are disjoint, so each
+// task only touches its own part.
+struct rank_carry_t {
+  const CSRGraph &graph;
+  prfas::RankVec rank;
+  // Whether a previous round has stored anything yet.
+  bool filled = false;
+};
+
+// Position of every edge of an SCC in the input graph, by SCC CSR position.
+static vector<size_t> input_positions(const prfas::SCC &scc,
+                                      const CSRGraph &graph) {
+  const CSRGraph &scc_m = scc.first;
+  const vector<int> &v_index = scc.second;
+  vector<size_t> positions(scc_m.n_edges());
+  for (int v = 0; v < scc_m.size(); v++) {
+    for (size_t e = scc_m.offsets()[v]; e < scc_m.offsets()[v + 1]; e++) {
+      positions[e] =
+          graph.edge_position(v_index[v], v_index[scc_m.neighbors()[e]]);
+    }
+  }
+  return positions;
+}
+
+// Returns the sorted CSR positions of the highest ranked edges of an SCC.
+static vector<size_t> max_rank_edges(const prfas::SCC &scc,
+                                     const prfas::page_rank_options_t &options,
+                                     rank_carry_t *carry) {
+  TraceScope scope("rank_scc");
+  scope.arg("edges", scc.first.n_edges());
+  const CSRGraph &scc_m = scc.first;
+  const vector<int> &v_index = scc.second;
+  vector<size_t> positions;
+  if (implicit_line_graph_page_rank) {
+    prfas::RankVec init;
+    if (carry != nullptr && carry->filled) {
+      init.resize(scc_m.n_edges());
+      for (int v = 0; v < scc_m.size(); v++) {
+        std::fill(init.begin() + scc_m.offsets()[v],
+                  init.begin() + scc_m.offsets()[v + 1],
+                  carry->rank[v_index[v]]);
+      }
+    }
+    const auto &rank =
+        prfas::line_graph_page_rank(scc_m, options, std::move(init));
+    for (const int e : top_ranked(rank)) {
+      positions.push_back(e);
+    }
+    for (int v = 0; carry != nullptr && v < scc_m.size(); v++) {
+      // Every vertex of an SCC has out edges.
+      carry->rank[v_index[v]] = rank[scc_m.offsets()[v]];
+    }
+  } else {
+    vector<size_t> input_pos;
+    if (carry != nullptr) {
+      input_pos = input_positions(scc, carry->graph);
+    }
+    // e_graph, edges = line_graph(scc)
+    const auto &lg = prfas::line_graph(scc_m, options.pool);
+    const CSRGraph &e_graph = lg.first;
+    // Line graph nodes are the CSR positions of the edges of scc_m.
+    prfas::RankVec init;
+    if (carry != nullptr && carry->filled) {
+      for (const size_t pos : input_pos) {
+        init.push_back(carry->rank[pos]);
+      }
+    }
+    // rank = page_rank(scc)
+    const auto &rank = prfas::page_rank(e_graph, options, std::move(init));
+    // fa_index = argmax(rank)
+    for (const int fa_index : top_ranked(rank)) {
+      positions.push_back(fa_index);
+    }
+    for (size_t i = 0; i < input_pos.size(); i++) {
+      carry->rank[input_pos[i]] = rank[i];
+    }
+  }
+  std::sort(positions.begin(), positions.end());
+  return positions;
+}
+
+FAS page_rank_fas(const CSRGraph &original_mat) {
+  TraceScope scope("page_rank_fas");
   // FAS = []
   FAS result;
+  // A self-loop is a cycle on its own, which a one-vertex SCC never shows, so
+  // every one goes into the FAS up front and the SCCs leave them out.
+  vector<bool> loops;
+  for (int v = 0; v < original_mat.size(); v++) {
+    const int64_t pos = original_mat.edge_position(v, v);
+    if (pos >= 0) {
+      loops.resize(original_mat.n_edges(), false);
+      loops[pos] = true;
+      result.emplace_back(v, v);
+    }
+  }
   // Extract SCCs from mat
-  SparseMatrix mat(original_mat);
-  prfas::SCC_Solver solver(mat);
-  solver();
+  ThreadPool pool(fas_threads);
+  const vector<bool> *removed = loops.empty() ? nullptr : &loops;
+  vector<prfas::SCC> sccs;
+  if (pool.size() > 1) {
+    sccs = prfas::parallel_scc(original_mat, pool, removed);
+  } else {
+    prfas::SCC_Solver solver(original_mat, removed);
+    solver();
+    sccs = std::move(solver.result_scc);
+    // The order parallel_scc uses, so the FAS is the same for any -j.
+    prfas::sort_by_first_vertex(sccs);
+  }
+  vector<prfas::SCC> next;
+  prfas::page_rank_options_t options;
+  options.max_iter = fas_max_iter;
+  options.stop_error = fas_stop_error;
+  options.residual_push = fas_residual_push;
+  options.solver = fas_page_rank_solver;
+  options.stable_top = fas_batch_size > 0 ? fas_batch_size : 1;
+  options.stable_iterations = fas_stable_iterations;
+  options.stable_gap = fas_stable_gap;
+  page_rank_fas_stats = page_rank_fas_stats_t();
+  const int exact_size = std::min(fas_exact_size, prfas::EXACT_FAS_MAX_SIZE);
+  rank_carry_t carry{original_mat, {}};
+  if (fas_warm_start) {
+    carry.rank.resize(implicit_line_graph_page_rank ? original_mat.size()
+                                                    : original_mat.n_edges());
+  }
+  rank_carry_t *warm = fas_warm_start ? &carry : nullptr;
   // While SCCs is not empty:
-  while (!solver.result_scc.empty()) {
+  while (!sccs.empty()) {
+    // Components are independent, so they are handled concurrently, largest
+    // first. Each one writes only its own slot and slots are merged in order,
+    // which keeps the FAS the same for any number of threads.
+    std::stable_sort(sccs.begin(), sccs.end(),
+                     [](const prfas::SCC &a, const prfas::SCC &b) {
+                       return a.first.n_edges() > b.first.n_edges();
+                     });
+    TraceScope round("round");
+    round.arg("sccs", sccs.size());
+    round.arg("largest_scc_edges", sccs[0].first.n_edges());
+    trace_counter("sccs", sccs.size());
+    vector<vector<size_t>> fa_pos(sccs.size());
+    vector<vector<prfas::SCC>> children(sccs.size());
+    vector<prfas::page_rank_stats_t> stats(sccs.size());
+    // Small SCCs are solved exactly and leave nothing behind.
+    vector<char> exact(sccs.size(), false);
     //   for scc, v_index in SCCs:
-    for (const prfas::SCC &scc : solver.result_scc) {
-      const SparseMatrix &scc_m = scc.first;
-      const vector<int> &v_index = scc.second;
-      //     e_graph, edges = line_graph(scc)
-      const auto &lg = prfas::line_graph(scc_m);
-      const SparseMatrix &e_graph = lg.first;
-      const vector<Edge> &edges = lg.second;
-      //     rank = page_rank(scc)
-      const auto &rank = prfas::page_rank(e_graph);
-      //     fa_index = argmax(rank)
-      int fa_index = argmax(rank);
-      //     fa_scc = edges[fa_index]
-      const Edge &fa_scc = edges[fa_index];
-      //     fa = {v_index[fa_scc.from], v_index[fa_scc.to]}
-      Edge fa = {v_index[fa_scc.first], v_index[fa_scc.second]};
-      //     FAS.append(fa)
-      result.push_back(fa);
-      //     mat.remove(fa)
-      remove_edge(mat, fa);
-    }
-    //   Extract SCCs from mat
-    solver();
+    size_t n_big = 0;
+    if (pool.size() > 1) {
+      while (n_big < sccs.size() &&
+             sccs[n_big].first.n_edges() >= PARALLEL_KERNEL_EDGES) {
+        //     fa_scc = edges[argmax(page_rank(line_graph(scc)))]
+        prfas::page_rank_options_t threaded = options;
+        threaded.pool = &pool;
+        threaded.stats = &stats[n_big];
+        fa_pos[n_big] = max_rank_edges(sccs[n_big], threaded, warm);
+        //     scc.remove(fa), then extract SCCs from what is left of it
+        prfas::remove_and_split(sccs[n_big], fa_pos[n_big], children[n_big]);
+        n_big++;
+      }
+    }
+    pool.parallel_for(sccs.size() - n_big, [&](size_t i) {
+      i += n_big;
+      if (sccs[i].first.size() <= exact_size) {
+        fa_pos[i] = prfas::exact_fas(sccs[i].first);
+        exact[i] = true;
+        return;
+      }
+      prfas::page_rank_options_t own = options;
+      own.stats = &stats[i];
+      fa_pos[i] = max_rank_edges(sccs[i], own, warm);
+      prfas::remove_and_split(sccs[i], fa_pos[i], children[i]);
+    });
+    for (size_t i = 0; i < sccs.size(); i++) {
+      if (exact[i]) {
+        page_rank_fas_stats.exact++;
+        continue;
+      }
+      const prfas::page_rank_stats_t &run = stats[i];
+      page_rank_fas_stats.runs++;
+      page_rank_fas_stats.iterations += run.iterations;
+      page_rank_fas_stats.max_iterations =
+          std::max(page_rank_fas_stats.max_iterations, run.iterations);
+      page_rank_fas_stats.converged += run.converged;
+      page_rank_fas_stats.stable += run.stable;
+    }
+    for (size_t i = 0; i < sccs.size(); i++) {
+      const CSRGraph &scc_m = sccs[i].first;
+      const vector<int> &v_index = sccs[i].second;
+      for (const size_t pos : fa_pos[i]) {
+        const Edge fa_scc = scc_m.edge_at(pos);
+        //     fa = {v_index[fa_scc.from], v_index[fa_scc.to]}
+        Edge fa = {v_index[fa_scc.first], v_index[fa_scc.second]};
+        //     FAS.append(fa)
+        result.push_back(fa);
+      }
+      std::move(children[i].begin(), children[i].end(),
+                std::back_inserter(next));
+    }
+    sccs.swap(next);
+    next.clear();
+    carry.filled = true;
+    trace_counter("fas_edges", result.size());
   }
   // return FAS;
   return result;
@@ -1,6 +1,8 @@
 #pragma once
 #include "common.h"
 
+class ThreadPool;
+
 namespace prfas {
 using RankVec = std::vector<float>;
 using std::pair;
@@ -17,70 +19,172 @@ inline Edge decode_edge(uint64_t edge_code) {
   return {edge_code >> 32, edge_code & UINT32_MAX};
 }
 
+// What a PageRank run did.
+struct page_rank_stats_t {
+  // Sweeps done. Residual pushes count by how many sweeps their work is worth.
+  int iterations = 0;
+  // L1 change of the rank vector in the last sweep.
+  float error = 0;
+  // Whether it stopped on stop_error rather than on max_iter.
+  bool converged = false;
+  // Whether it stopped because the top ranks settled, see stable_iterations.
+  bool stable = false;
+};
+
+// Knobs of a PageRank run. The defaults are the setup of the original paper.
+struct page_rank_options_t {
+  // Damping factor
+  float beta = 1;
+  // Maximum iteration numbers
+  int max_iter = 30;
+  // Stop once a sweep changes the rank vector by less than this in L1 norm.
+  float stop_error = 1e-5;
+  // Threads to split the rows over, nullptr = calling thread only.
+  ThreadPool *pool = nullptr;
+  // With a warm start, first settle the residual of the initial vector by
+  // local pushes (Andersen-Chung-Lang style), which only touch vertices whose
+  // rank is still off. Falls back to full sweeps if the pushes don't settle.
+  bool residual_push = false;
+  // How to sweep, see PageRankSolver.
+  PageRankSolver solver = PageRankSolver::JACOBI;
+  // Callers that only need the order of the best few entries may stop early:
+  // once the stable_top best entries (in order) stayed the same for
+  // stable_iterations sweeps, or once they stayed for a sweep and the k-th is
+  // ahead of the next by more than stable_gap (relative to the k-th).
+  // 0 = rule off. Line graph ranks compare edges, not the per-vertex totals.
+  // Not applied to residual pushes.
+  int stable_top = 1;
+  int stable_iterations = 0;
+  float stable_gap = 0;
+  // If set, receives what the run did.
+  page_rank_stats_t *stats = nullptr;
+};
+
 // Page Rank computation function
-// @param mat : The graph matrix consisting of only 0 and 1
-// @param beta : Damping factor
-// @param max_iter : Maximum iteration numbers
-// @param stop_error : Error threshold, not yet implemented.
+// @param mat : The graph to rank
+// @param options : See page_rank_options_t
+// @param init : Initial rank vector, e.g. the result of a previous round on a
+//               similar graph. Empty = uniform. Rescaled to sum up to 1.
 // @return : the result rank vector.
-RankVec page_rank(const SparseMatrix &mat, float beta = 1, int max_iter = 30,
-                  float stop_error = 1e-5);
+RankVec page_rank(const CSRGraph &mat, const page_rank_options_t &options,
+                  RankVec init = {});
+
+inline RankVec page_rank(const CSRGraph &mat, float beta = 1,
+                         int max_iter = 30, float stop_error = 1e-5) {
+  return page_rank(mat, page_rank_options_t{beta, max_iter, stop_error});
+}
+
+// PageRank on the line graph of G, without materializing the line graph.
+// Line graph node (u, v) sends rank to every (v, w), so an iteration only needs
+// the rank flowing into each vertex v: O(n + m) time and memory.
+// @param G : the graph whose line graph is ranked, needs to be strongly
+//            connected
+// @param init : Initial rank of each edge of G by CSR position, empty = uniform
+// @return : rank of each edge of G, indexed by its CSR position.
+RankVec line_graph_page_rank(const CSRGraph &G,
+                             const page_rank_options_t &options,
+                             RankVec init = {});
+
+inline RankVec line_graph_page_rank(const CSRGraph &G, float beta = 1,
+                                    int max_iter = 30,
+                                    float stop_error = 1e-5) {
+  return line_graph_page_rank(G,
+                              page_rank_options_t{beta, max_iter, stop_error});
+}
 
-// Calculates the line graph in 1 pass via DFS or for loop.
+// Calculates the line graph via DFS or for loop, into rows sized up front.
 // @param G : the graph to compute line graph on, need to be strongly connected
-// @return : The result line graph and the edge index to recover edge info
-auto line_graph(const SparseMatrix &G) -> pair<SparseMatrix, vector<Edge>>;
+// @param pool : fills the rows on these threads, nullptr = calling thread
+// @return : The result line graph and the edge index to recover edge info.
+//           Line graph vertex k is the edge at CSR position k of G.
+auto line_graph(const CSRGraph &G, ThreadPool *pool = nullptr)
+    -> pair<CSRGraph, vector<Edge>>;
 
 // Feedback arcs only exist in a strongly connected directed graph.
 // So extracting strongly connected components not only narrows searching range
 // but also detects cycle! Another problem solved!W
 
-using SCC = std::pair<SparseMatrix, std::vector<int>>;
+// A component as its own CSR over local ids 0..k-1, and the vertex of the
+// input graph behind each local id (ascending). It is a packed copy, not a
+// view of the input: the PageRank kernels and line graph builders index rank
+// by contiguous id and pull over transposed rows, which a view through the
+// relabel array and removed-edge bitmap couldn't give them without a second
+// pass per sweep. Packing is one linear pass per component per round.
+using SCC = std::pair<CSRGraph, std::vector<int>>;
 
-// SCC solver: extracts all SCCs with >1 vertices using Tarjan's Algorithm
+// SCC solver: extracts all SCCs with >1 vertices using Tarjan's Algorithm.
+// The DFS keeps its own stack of frames, so any depth works. Its arrays live
+// in a per-thread workspace that later solvers reuse; an epoch counter tells
+// this call's entries from stale ones, so nothing is cleared per call.
 class SCC_Solver {
-  static constexpr int NIL = -1;
-  const SparseMatrix &mat;
-  std::stack<int> st;
-  // Current node's discovery time
-  int time;
-  // Stores the discovery times of the nodes
-  std::vector<int> disc;
-  // Stores the nodes with least discovery time
-  std::vector<int> low;
-  // Checks whether a node is in the stack or not
-  std::vector<bool> stack_member;
-
-  // A Recursive DFS based function used by SCC
-  void scc_util(int u);
+  const CSRGraph &mat;
+  // Edges of mat to leave out, by CSR position. nullptr = none.
+  const std::vector<bool> *removed;
+
+  bool kept(size_t pos) const {
+    return removed == nullptr || !(*removed)[pos];
+  }
 
 public:
   // The result SCC
   std::vector<SCC> result_scc;
 
-  explicit SCC_Solver(const SparseMatrix &mat)
-      : mat(mat), disc(mat.size()), low(mat.size()), stack_member(mat.size()){};
+  // @param removed : edges to ignore by CSR position, e.g. the ones just
+  //                  removed from an SCC, so it needn't be copied first.
+  explicit SCC_Solver(const CSRGraph &mat,
+                      const std::vector<bool> *removed = nullptr)
+      : mat(mat), removed(removed){};
   ~SCC_Solver() = default;
   const std::vector<SCC> &operator()();
 };
 
-// Implements the DFS line graph generation in original paper.
+// Orders SCCs by their smallest vertex.
+void sort_by_first_vertex(std::vector<SCC> &sccs);
+
+// The SCCs SCC_Solver finds, found with the threads of pool and ordered by
+// sort_by_first_vertex. Vertices without open in or out neighbors are peeled
+// off repeatedly in parallel, then the SCC of the open vertex with the
+// largest in * out degree comes from a parallel forward and backward search,
+// and after another peel the rest goes through SCC_Solver. On real graphs
+// the peels and the one search take nearly everything.
+// @param removed : edges to ignore by CSR position, nullptr = none.
+std::vector<SCC> parallel_scc(const CSRGraph &mat, ThreadPool &pool,
+                              const std::vector<bool> *removed = nullptr);
+
+// Removes the edges at positions pos (sorted ascending) from an SCC and
+// appends the SCCs left of it to out. Only this component is re-split, so the
+// cost scales with its size rather than with the whole graph.
+void remove_and_split(const SCC &scc, const std::vector<size_t> &pos,
+                      std::vector<SCC> &out);
+
+// Most vertices exact_fas takes, as it keeps a table of 2^n entries.
+constexpr int EXACT_FAS_MAX_SIZE = 20;
+
+// The CSR positions (ascending) of a minimum FAS of g, by dynamic
+// programming over the vertex subsets in O(2^n * n). 2 and 3 vertices are
+// settled directly, without the table.
+// @param g : no self-loops and at most EXACT_FAS_MAX_SIZE vertices
+std::vector<size_t> exact_fas(const CSRGraph &g);
+
+// Implements the DFS line graph generation in original paper, filling the
+// rows line_graph sized. Line graph vertices are numbered by the CSR position
+// of their edge in mat.
 class LineGraphGeneator {
-  const SparseMatrix &mat;
-  SparseMatrix line_graph;
-  unordered_map<uint64_t, int> edge_index;
-  vector<Edge> edge_table;
+  const CSRGraph &mat;
+  // Next free slot of every row of the line graph.
+  vector<size_t> cursor;
+  vector<int> &neighbors;
   vector<bool> visited;
 
 public:
-  explicit LineGraphGeneator(const SparseMatrix &mat, const int n_edges)
-      : mat(mat), visited(mat.size(), false), line_graph(n_edges),
-        edge_table(n_edges){};
+  // @param offsets : row offsets of the line graph, see line_graph
+  // @param neighbors : sized to offsets.back(), filled by operator()
+  explicit LineGraphGeneator(const CSRGraph &mat, const vector<size_t> &offsets,
+                             vector<int> &neighbors)
+      : mat(mat), cursor(offsets.begin(), offsets.end() - 1),
+        neighbors(neighbors), visited(mat.size(), false){};
   ~LineGraphGeneator() = default;
   void dfs_util(int curr, int prev);
-  pair<SparseMatrix, vector<Edge>> operator()() {
-    dfs_util(0, -1);
-    return {line_graph, edge_table};
-  }
+  void operator()();
 };
 } // namespace prfas
\ No newline at end of file
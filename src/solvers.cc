@@ -0,0 +1,32 @@
+#include "common.h"
+
+// Variants are told apart by the globals select_solver sets.
+static const std::vector<std::pair<std::string, fas_solver>> solvers{
+    {"sort", sort_fas},
+    {"sort_multi", sort_fas},
+    {"greedy", greedy_fas},
+    {"greedy_opt", greedy_fas_optimized},
+    {"page_rank", page_rank_fas},
+    {"page_rank_lb", page_rank_fas},
+    {"page_rank_implicit", page_rank_fas}};
+
+std::vector<std::string> solver_names() {
+  std::vector<std::string> names;
+  for (const auto &[name, _] : solvers) {
+    names.push_back(name);
+  }
+  return names;
+}
+
+bool select_solver(const std::string &name, fas_solver &solver) {
+  for (const auto &[solver_name, function] : solvers) {
+    if (solver_name == name) {
+      solver = function;
+      loop_based_line_graph_gen = name == "page_rank_lb";
+      implicit_line_graph_page_rank = name == "page_rank_implicit";
+      sort_fas_multi_start = name == "sort_multi";
+      return true;
+    }
+  }
+  return false;
+}
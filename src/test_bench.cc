@@ -1,4 +1,7 @@
 #include "common.h"
+#include "graph_io.h"
+#include "input_parser.h"
+#include "trace.h"
 #include <algorithm>
 #include <chrono>
 #include <cstdio>
@@ -6,81 +9,23 @@
 #include <string>
 using std::string;
 
-class InputParser {
-public:
-  InputParser(int argc, const char *argv[]) {
-    for (int i = 1; i < argc; ++i) {
-      this->tokens_.emplace_back(argv[i]);
-    }
-  }
-  /// @author iain
-  const std::string &get_option(const std::string &option) const {
-    std::vector<std::string>::const_iterator itr;
-    itr = std::find(this->tokens_.begin(), this->tokens_.end(), option);
-    if (itr != this->tokens_.end() && ++itr != this->tokens_.end()) {
-      return *itr;
-    }
-    static const std::string empty_string;
-    return empty_string;
-  }
-  /// @author iain
-  bool option_exists(const std::string &option) const {
-    return std::find(this->tokens_.begin(), this->tokens_.end(), option) !=
-           this->tokens_.end();
-  }
-
-private:
-  std::vector<std::string> tokens_;
-};
-
-auto read_input(const string &filename) -> std::pair<SparseMatrix, int> {
+auto read_input(const string &filename) -> std::pair<CSRGraph, int> {
   if (filename.empty()) { // Use standard example from TA's PPT.
-    SparseMatrix mat(7);
-    add_edge(mat, 0, 1);
-    add_edge(mat, 1, 2);
-    add_edge(mat, 2, 3);
-    add_edge(mat, 3, 0);
-    add_edge(mat, 3, 1);
-    add_edge(mat, 4, 5);
-    add_edge(mat, 5, 6);
-    add_edge(mat, 6, 4);
-    return {mat, 8};
-  }
-  FILE *file = fopen(filename.c_str(), "r");
-  if (file == nullptr) {
-    printf("File '%s' doesn't exist.\n", filename.c_str());
-    return {};
+    return {example_graph(), 8};
   }
-  int size, from, to, n_edges = 0;
-  int n_scanned = fscanf(file, "%d", &size);
-  if (n_scanned != 1) {
-    printf("Can't read graph size\n");
+  CSRGraph mat;
+  if (const ReadStatus status = read_graph(filename, mat);
+      status != ReadStatus::OK) {
+    printf("%s: '%s'\n", describe(status), filename.c_str());
     return {};
   }
-  char sep[4];
-  SparseMatrix mat(size);
-  while (n_scanned != EOF) {
-    n_scanned = fscanf(file, "%d%3[ ,]%d", &from, sep, &to);
-    switch (n_scanned) {
-    case 3:
-      add_edge(mat, from, to);
-      n_edges++;
-      break;
-    case EOF:
-      continue;
-    default:
-      puts("Input pattern mismatch");
-      return {};
-    }
-  }
-  return {mat, n_edges};
+  const int n_edges = mat.n_edges();
+  return {std::move(mat), n_edges};
 }
-std::unordered_map<std::string, fas_solver> func_mapping{
-    {"sort", sort_fas},
-    {"greedy", greedy_fas},
-    {"greedy_opt", greedy_fas_optimized},
-    {"page_rank", page_rank_fas},
-    {"page_rank_lb", page_rank_fas}};
+std::unordered_map<std::string, PageRankSolver> page_rank_solver_mapping{
+    {"jacobi", PageRankSolver::JACOBI},
+    {"gauss_seidel", PageRankSolver::GAUSS_SEIDEL},
+    {"extrapolation", PageRankSolver::EXTRAPOLATION}};
 
 // test_bench.cc
 int main(int argc, const char *argv[]) {
@@ -91,16 +36,65 @@ int main(int argc, const char *argv[]) {
   string solver_name = "page_rank";
   if (parser.option_exists("-s")) {
     solver_name = parser.get_option("-s");
-    if (auto it = func_mapping.find(solver_name); it != func_mapping.end()) {
-      solver_function = func_mapping[solver_name];
-    } else {
+    if (!select_solver(solver_name, solver_function)) {
       return -1;
     }
   }
   printf("Solver: %s\n", solver_name.c_str());
 
-  if (solver_name == "page_rank_lb") {
-    loop_based_line_graph_gen = true;
+  if (parser.option_exists("-k")) {
+    fas_batch_size = std::stoi(parser.get_option("-k"));
+  }
+  if (parser.option_exists("-t")) {
+    fas_batch_tolerance = std::stof(parser.get_option("-t"));
+    // The tolerance picks the batch, so it is uncapped unless -k says so.
+    if (!parser.option_exists("-k")) {
+      fas_batch_size = 0;
+    }
+  }
+  if (parser.option_exists("-j")) {
+    fas_threads = std::stoi(parser.get_option("-j"));
+  }
+  if (parser.option_exists("-w")) {
+    fas_warm_start = true;
+  }
+  if (parser.option_exists("-r")) {
+    fas_warm_start = true;
+    fas_residual_push = true;
+  }
+  if (parser.option_exists("-m")) {
+    const string &name = parser.get_option("-m");
+    if (auto it = page_rank_solver_mapping.find(name);
+        it != page_rank_solver_mapping.end()) {
+      fas_page_rank_solver = it->second;
+    } else {
+      printf("Unknown PageRank method '%s'\n", name.c_str());
+      return -1;
+    }
+  }
+  if (parser.option_exists("-e")) {
+    fas_stop_error = std::stof(parser.get_option("-e"));
+  }
+  if (parser.option_exists("-n")) {
+    fas_max_iter = std::stoi(parser.get_option("-n"));
+  }
+  if (parser.option_exists("-a")) {
+    fas_stable_iterations = std::stoi(parser.get_option("-a"));
+  }
+  if (parser.option_exists("-g")) {
+    fas_stable_gap = std::stof(parser.get_option("-g"));
+  }
+  if (parser.option_exists("-x")) {
+    fas_exact_size = std::stoi(parser.get_option("-x"));
+  }
+  if (fas_batch_size != 1) {
+    printf("Batch: remove edges within %.2f%% of max rank per SCC, ",
+           fas_batch_tolerance * 100);
+    if (fas_batch_size > 0) {
+      printf("up to %d\n", fas_batch_size);
+    } else {
+      puts("no cap");
+    }
   }
 
   string input_file = parser.get_option("-i");
@@ -109,7 +103,12 @@ int main(int argc, const char *argv[]) {
     puts("Read input failed. Abort.");
     return -1;
   }
-  printf("Testing graph has %lu vertices and %d edges\n", mat.size(), n_edges);
+  printf("Testing graph has %d vertices and %d edges\n", mat.size(), n_edges);
+
+  const string &trace_file = parser.get_option("-T");
+  trace_memory = parser.option_exists("-M");
+  trace_enabled = !trace_file.empty() || trace_memory;
+  trace_reset();
 
   printf("Solving start...");
   fflush(stdout);
@@ -123,7 +122,44 @@ int main(int argc, const char *argv[]) {
 
   float fas_percentage = result.size() * static_cast<float>(100) / n_edges;
   printf("Result FAS size = %lu (%.2f%%)\n", result.size(), fas_percentage);
-  // Do some validation and test.
+  if (page_rank_fas_stats.runs > 0) {
+    const page_rank_fas_stats_t &stats = page_rank_fas_stats;
+    printf("PageRank runs = %ld, iterations = %ld (avg %.2f, max %d), "
+           "converged = %ld, stopped on stable top = %ld\n",
+           stats.runs, stats.iterations,
+           static_cast<double>(stats.iterations) / stats.runs,
+           stats.max_iterations, stats.converged, stats.stable);
+  }
+  if (page_rank_fas_stats.exact > 0) {
+    printf("SCCs solved exactly = %ld\n", page_rank_fas_stats.exact);
+  }
+  if (trace_memory) {
+    const memory_stats_t memory = memory_stats();
+    printf("Heap: %.3f MB in %lld allocations, peak %.3f MB live\n",
+           memory.allocated_bytes / 1048576.0,
+           static_cast<long long>(memory.allocations),
+           memory.peak_bytes / 1048576.0);
+    printf("Process peak RSS = %.3f MB\n", peak_rss_bytes() / 1048576.0);
+  }
+  if (trace_enabled) {
+    puts("");
+    print_trace_summary();
+    if (!trace_file.empty() && !write_chrome_trace(trace_file)) {
+      printf("Can't write trace '%s'\n", trace_file.c_str());
+    }
+  }
+  if (parser.option_exists("-v")) {
+    printf("Validating FAS...");
+    fflush(stdout);
+    start = std::chrono::high_resolution_clock::now();
+    const FasStatus status = validate_fas(mat, result, fas_threads);
+    end = std::chrono::high_resolution_clock::now();
+    time = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    printf("%s (%.3f ms)\n", describe(status), time.count() * 1e-6);
+    if (status != FasStatus::VALID) {
+      return -1;
+    }
+  }
 
   if (parser.option_exists("-p")) {
     puts("\nResult FAS:");
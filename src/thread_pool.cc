@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+int ThreadPool::resolve_size(int n_threads) {
+  if (n_threads <= 0) {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+  return n_threads;
+}
+
+ThreadPool::ThreadPool(int n_threads) {
+  n_threads = resolve_size(n_threads);
+  queues_ = std::vector<queue_t>(n_threads);
+  for (int i = 1; i < n_threads; i++) {
+    workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+bool ThreadPool::pop(int self, size_t &index) {
+  {
+    queue_t &own = queues_[self];
+    std::lock_guard<std::mutex> lock(own.mtx);
+    if (!own.tasks.empty()) {
+      index = own.tasks.front();
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  for (int i = 1; i < size(); i++) {
+    queue_t &victim = queues_[(self + i) % size()];
+    std::lock_guard<std::mutex> lock(victim.mtx);
+    if (!victim.tasks.empty()) {
+      index = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+// Tasks are only queued before a job starts, so once every deque is seen
+// empty there is nothing left for this thread to do.
+void ThreadPool::run(int self) {
+  size_t index;
+  while (pop(self, index)) {
+    (*task_)(index);
+  }
+}
+
+void ThreadPool::worker_loop(int self) {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    run(self);
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (--active_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::parallel_for(size_t n,
+                              const std::function<void(size_t)> &task) {
+  if (workers_.empty() || n <= 1) {
+    for (size_t i = 0; i < n; i++) {
+      task(i);
+    }
+    return;
+  }
+  // Deal indices round-robin, so every thread starts on one of the heaviest.
+  for (size_t i = 0; i < n; i++) {
+    queue_t &queue = queues_[i % size()];
+    std::lock_guard<std::mutex> lock(queue.mtx);
+    queue.tasks.push_back(i);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    task_ = &task;
+    active_ = workers_.size();
+    generation_++;
+  }
+  start_cv_.notify_all();
+  run(0);
+  std::unique_lock<std::mutex> lock(mtx_);
+  done_cv_.wait(lock, [&] { return active_ == 0; });
+  task_ = nullptr;
+}
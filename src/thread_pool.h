@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing pool for fork-join loops.
+// Every thread (the caller included) owns a deque of task indices. It takes
+// work from the front of its own deque and, once that is empty, steals from
+// the back of the others, so a few heavy tasks don't leave threads idle.
+class ThreadPool {
+  struct queue_t {
+    std::mutex mtx;
+    std::deque<size_t> tasks;
+  };
+
+  std::vector<std::thread> workers_;
+  // queues_[0] belongs to the calling thread, queues_[i] to workers_[i - 1].
+  std::vector<queue_t> queues_;
+  std::mutex mtx_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(size_t)> *task_ = nullptr;
+  uint64_t generation_ = 0;
+  // Workers that haven't finished the current job yet.
+  int active_ = 0;
+  bool stop_ = false;
+
+  bool pop(int self, size_t &index);
+  void run(int self);
+  void worker_loop(int self);
+
+public:
+  // @param n_threads : number of threads including the caller, <= 0 means
+  //                    one per hardware thread.
+  explicit ThreadPool(int n_threads);
+  ~ThreadPool();
+
+  // The number of threads a pool of n_threads gets.
+  static int resolve_size(int n_threads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int size() const { return queues_.size(); }
+
+  // Runs task(i) for every i in [0, n) and returns when all are done.
+  // Lower indices are started first, so put the heaviest tasks in front.
+  void parallel_for(size_t n, const std::function<void(size_t)> &task);
+};
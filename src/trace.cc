@@ -0,0 +1,313 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+bool trace_enabled = false;
+bool trace_memory = false;
+
+/* **********************************
+ * Allocation counter
+ ********************************** */
+
+namespace {
+
+std::atomic<bool> counting{false};
+std::atomic<int64_t> allocated_bytes{0};
+std::atomic<int64_t> allocations{0};
+std::atomic<int64_t> live_bytes{0};
+std::atomic<int64_t> peak_bytes{0};
+
+// Bytes the allocator really handed out for p, so frees match allocations.
+inline int64_t block_size(void *p, [[maybe_unused]] size_t requested) {
+#if defined(__GLIBC__)
+  return malloc_usable_size(p);
+#else
+  return requested;
+#endif
+}
+
+inline void raise_peak(int64_t live) {
+  int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+inline void count_alloc(void *p, size_t size) {
+  if (!counting.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const int64_t bytes = block_size(p, size);
+  allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  raise_peak(live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+inline void count_free(void *p) {
+#if defined(__GLIBC__)
+  // Blocks from before counting started make live dip below 0, which only
+  // shifts it by a constant.
+  if (p != nullptr && counting.load(std::memory_order_relaxed)) {
+    live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+  }
+#endif
+}
+
+void *allocate(size_t size) {
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  count_alloc(p, size);
+  return p;
+}
+
+} // namespace
+
+// Replacing the global operators is what lets every container be counted.
+// Over-aligned allocations keep the default operators and are not counted.
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void operator delete(void *p) noexcept {
+  count_free(p);
+  std::free(p);
+}
+void operator delete[](void *p) noexcept {
+  count_free(p);
+  std::free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+  count_free(p);
+  std::free(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+  count_free(p);
+  std::free(p);
+}
+
+memory_stats_t memory_stats() {
+  memory_stats_t stats;
+  stats.allocated_bytes = allocated_bytes.load();
+  stats.allocations = allocations.load();
+  stats.live_bytes = live_bytes.load();
+  stats.peak_bytes = peak_bytes.load();
+  return stats;
+}
+
+int64_t peak_rss_bytes() {
+#if !defined(_WIN32)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    // Kilobytes on Linux
+    return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+  }
+#endif
+  return -1;
+}
+
+/* **********************************
+ * Events
+ ********************************** */
+
+namespace {
+
+struct event_t {
+  const char *name;
+  // 'X' for a timed scope, 'C' for a counter.
+  char phase;
+  int tid;
+  int64_t start_ns;
+  int64_t duration_ns;
+  const char *keys[TraceScope::MAX_ARGS];
+  int64_t values[TraceScope::MAX_ARGS];
+  int n_args;
+  // Allocations inside a scope, -1 if not tracked.
+  int64_t allocated_bytes;
+  int64_t allocations;
+  // Rise of live heap bytes above the start of the scope.
+  int64_t peak_bytes;
+};
+
+std::mutex events_mtx;
+std::vector<event_t> events;
+std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - origin)
+      .count();
+}
+
+// Small ids instead of std::thread::id, numbered as threads first record.
+int thread_index() {
+  static std::atomic<int> next_tid{0};
+  thread_local const int tid = next_tid++;
+  return tid;
+}
+
+void push(const event_t &event) {
+  std::lock_guard<std::mutex> lock(events_mtx);
+  events.push_back(event);
+}
+
+} // namespace
+
+TraceScope::TraceScope(const char *name)
+    : name_(name), start_ns_(trace_enabled ? now_ns() : -1) {
+  if (start_ns_ >= 0 && trace_memory) {
+    start_allocated_ = allocated_bytes.load(std::memory_order_relaxed);
+    start_allocations_ = allocations.load(std::memory_order_relaxed);
+    start_live_ = live_bytes.load(std::memory_order_relaxed);
+    // Track the peak of this scope alone, then hand it back to the outer one.
+    outer_peak_ = peak_bytes.exchange(start_live_);
+  }
+}
+
+void TraceScope::record() {
+  event_t event{};
+  event.name = name_;
+  event.phase = 'X';
+  event.tid = thread_index();
+  event.start_ns = start_ns_;
+  event.duration_ns = now_ns() - start_ns_;
+  std::copy(keys_, keys_ + n_args_, event.keys);
+  std::copy(values_, values_ + n_args_, event.values);
+  event.n_args = n_args_;
+  event.allocated_bytes = event.allocations = event.peak_bytes = -1;
+  if (start_allocated_ >= 0) {
+    event.allocated_bytes = allocated_bytes.load() - start_allocated_;
+    event.allocations = allocations.load() - start_allocations_;
+    const int64_t peak = peak_bytes.load();
+    event.peak_bytes = peak - start_live_;
+    raise_peak(outer_peak_);
+  }
+  push(event);
+}
+
+void trace_counter(const char *name, int64_t value) {
+  if (trace_enabled) {
+    event_t event{};
+    event.name = name;
+    event.phase = 'C';
+    event.tid = thread_index();
+    event.start_ns = now_ns();
+    event.keys[0] = "value";
+    event.values[0] = value;
+    event.n_args = 1;
+    event.allocated_bytes = event.allocations = event.peak_bytes = -1;
+    push(event);
+  }
+}
+
+void trace_reset() {
+  std::lock_guard<std::mutex> lock(events_mtx);
+  events.clear();
+  origin = std::chrono::steady_clock::now();
+  counting = trace_enabled && trace_memory;
+  allocated_bytes = allocations = live_bytes = peak_bytes = 0;
+}
+
+std::vector<trace_total_t> trace_totals() {
+  std::vector<trace_total_t> totals;
+  std::unordered_map<std::string, size_t> index;
+  std::lock_guard<std::mutex> lock(events_mtx);
+  for (const event_t &event : events) {
+    if (event.phase != 'X') {
+      continue;
+    }
+    auto [it, added] = index.emplace(event.name, totals.size());
+    if (added) {
+      totals.push_back({event.name});
+    }
+    trace_total_t &total = totals[it->second];
+    total.count++;
+    total.total_ns += event.duration_ns;
+    total.max_ns = std::max(total.max_ns, event.duration_ns);
+    if (event.allocated_bytes < 0) {
+      continue;
+    }
+    if (total.allocated_bytes < 0) {
+      total.allocated_bytes = total.allocations = total.peak_bytes = 0;
+    }
+    total.allocated_bytes += event.allocated_bytes;
+    total.allocations += event.allocations;
+    total.peak_bytes = std::max(total.peak_bytes, event.peak_bytes);
+  }
+  std::stable_sort(totals.begin(), totals.end(),
+                   [](const trace_total_t &a, const trace_total_t &b) {
+                     return a.total_ns > b.total_ns;
+                   });
+  return totals;
+}
+
+void print_trace_summary() {
+  // Nested scopes are counted in their parents too, so totals overlap.
+  printf("%-20s %10s %14s %12s %12s", "Phase", "Count", "Total(ms)",
+         "Avg(ms)", "Max(ms)");
+  if (trace_memory) {
+    printf(" %14s %12s %12s", "Alloc(MB)", "Allocs", "Peak(MB)");
+  }
+  puts("");
+  for (const trace_total_t &total : trace_totals()) {
+    printf("%-20s %10ld %14.3f %12.4f %12.4f", total.name, total.count,
+           total.total_ns * 1e-6, total.total_ns * 1e-6 / total.count,
+           total.max_ns * 1e-6);
+    if (trace_memory && total.allocated_bytes < 0) {
+      printf(" %14s %12s %12s", "-", "-", "-");
+    } else if (trace_memory) {
+      printf(" %14.3f %12lld %12.3f", total.allocated_bytes / 1048576.0,
+             static_cast<long long>(total.allocations),
+             total.peak_bytes / 1048576.0);
+    }
+    puts("");
+  }
+}
+
+bool write_chrome_trace(const std::string &filename) {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(events_mtx);
+  fputs("{\"traceEvents\":[\n", file);
+  for (size_t i = 0; i < events.size(); i++) {
+    const event_t &event = events[i];
+    // Timestamps are in microseconds.
+    fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,"
+                  "\"ts\":%.3f",
+            event.name, event.phase, event.tid, event.start_ns * 1e-3);
+    if (event.phase == 'X') {
+      fprintf(file, ",\"dur\":%.3f", event.duration_ns * 1e-3);
+    }
+    fputs(",\"args\":{", file);
+    for (int k = 0; k < event.n_args; k++) {
+      fprintf(file, "%s\"%s\":%lld", k == 0 ? "" : ",", event.keys[k],
+              static_cast<long long>(event.values[k]));
+    }
+    if (event.allocated_bytes >= 0) {
+      fprintf(file, "%s\"alloc_bytes\":%lld,\"allocs\":%lld,"
+                    "\"peak_bytes\":%lld",
+              event.n_args == 0 ? "" : ",",
+              static_cast<long long>(event.allocated_bytes),
+              static_cast<long long>(event.allocations),
+              static_cast<long long>(event.peak_bytes));
+    }
+    fputs(i + 1 == events.size() ? "}}\n" : "}},\n", file);
+  }
+  fputs("]}\n", file);
+  return fclose(file) == 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-phase timing of the solvers. Nothing is recorded unless trace_enabled
+// is set, and then every TraceScope becomes one event with its wall time, so
+// a disabled scope costs a branch. Events can be summed up per name or saved
+// in the Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+extern bool trace_enabled;
+
+// With trace_enabled, also count heap allocations (operator new) per scope:
+// bytes and number of allocations made inside it, and how far live heap
+// bytes rose above where they were when it started. The high-water mark of a
+// scope is only exact if no other thread allocates meanwhile.
+extern bool trace_memory;
+
+// Heap usage seen by the allocation counter since trace_reset. Only counted
+// while trace_memory is set; live and peak need glibc to size frees.
+struct memory_stats_t {
+  int64_t allocated_bytes = 0;
+  int64_t allocations = 0;
+  int64_t live_bytes = 0;
+  int64_t peak_bytes = 0;
+};
+memory_stats_t memory_stats();
+
+// Peak resident set size of the process so far, -1 if unknown.
+int64_t peak_rss_bytes();
+
+// Times the enclosing block.
+// @param name : a string literal, events keep the pointer.
+class TraceScope {
+public:
+  static constexpr int MAX_ARGS = 3;
+
+  explicit TraceScope(const char *name);
+  ~TraceScope() {
+    if (start_ns_ >= 0) {
+      record();
+    }
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  // Attaches a number to the event, e.g. the size of the input. Only the
+  // first MAX_ARGS are kept. @param key : a string literal.
+  void arg(const char *key, int64_t value) {
+    if (start_ns_ >= 0 && n_args_ < MAX_ARGS) {
+      keys_[n_args_] = key;
+      values_[n_args_++] = value;
+    }
+  }
+
+private:
+  void record();
+
+  const char *name_;
+  int64_t start_ns_;
+  // Allocation counters when the scope started, -1 if not tracked.
+  int64_t start_allocated_ = -1;
+  int64_t start_allocations_;
+  int64_t start_live_;
+  // Peak of the enclosing scopes, restored on exit.
+  int64_t outer_peak_;
+  const char *keys_[MAX_ARGS];
+  int64_t values_[MAX_ARGS];
+  int n_args_ = 0;
+};
+
+// Records the value of a counter at this point in time, e.g. the number of
+// SCCs left after a round. @param name : a string literal.
+void trace_counter(const char *name, int64_t value);
+
+// Drops all events and restarts the clock.
+void trace_reset();
+
+// Events of one name summed up. Memory fields sum only the events recorded
+// with trace_memory, and are -1 if there were none.
+struct trace_total_t {
+  const char *name;
+  long count = 0;
+  int64_t total_ns = 0;
+  int64_t max_ns = 0;
+  int64_t allocated_bytes = -1;
+  int64_t allocations = -1;
+  // Highest peak_bytes of a single event.
+  int64_t peak_bytes = -1;
+};
+// Timed scopes recorded since trace_reset, most expensive first.
+std::vector<trace_total_t> trace_totals();
+
+// Prints count, total and max time per event name, most expensive first,
+// plus allocations if trace_memory is set.
+void print_trace_summary();
+
+// @return : false if the file can't be written.
+bool write_chrome_trace(const std::string &filename);
@@ -0,0 +1,126 @@
+#include "common.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+using std::vector;
+
+const char *describe(FasStatus status) {
+  switch (status) {
+  case FasStatus::VALID:
+    return "valid";
+  case FasStatus::MISSING_EDGE:
+    return "an edge is not in the graph";
+  case FasStatus::DUPLICATE_EDGE:
+    return "an edge is listed twice";
+  case FasStatus::CYCLIC:
+    return "the rest of the graph still has a cycle";
+  }
+  return "unknown";
+}
+
+// Below this many vertices or edges a step runs on the calling thread, which
+// keeps the many tiny levels of long paths cheap.
+static constexpr size_t VALIDATE_GRAIN = 4096;
+
+FasStatus validate_fas(const CSRGraph &mat, const FAS &fas, int n_threads) {
+  TraceScope scope("validate_fas");
+  const int n = mat.size();
+  const Span<size_t> offsets = mat.offsets();
+  const Span<int> neighbors = mat.neighbors();
+  ThreadPool pool(n_threads);
+  const auto blocks = [&pool](size_t size) {
+    return size < VALIDATE_GRAIN ? 1 : std::min<size_t>(size / VALIDATE_GRAIN,
+                                                        pool.size() * 8);
+  };
+  const auto for_blocks = [&](size_t size, const auto &task) {
+    const size_t n_blocks = blocks(size);
+    const auto run = [&](size_t b) {
+      task(b, size * b / n_blocks, size * (b + 1) / n_blocks);
+    };
+    if (n_blocks == 1) {
+      run(0);
+    } else {
+      pool.parallel_for(n_blocks, run);
+    }
+  };
+
+  // Mark the removed edges by their position in the rows.
+  std::unique_ptr<std::atomic<bool>[]> removed(
+      new std::atomic<bool>[neighbors.size()]);
+  for_blocks(neighbors.size(), [&](size_t, size_t begin, size_t end) {
+    for (size_t k = begin; k < end; k++) {
+      removed[k].store(false, std::memory_order_relaxed);
+    }
+  });
+  std::atomic<int> error{static_cast<int>(FasStatus::VALID)};
+  for_blocks(fas.size(), [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const auto [from, to] = fas[i];
+      if (from < 0 || from >= n || to < 0 || to >= n) {
+        error = static_cast<int>(FasStatus::MISSING_EDGE);
+        return;
+      }
+      const CSRGraph::Range row = mat.out(from);
+      const int *it = std::lower_bound(row.begin(), row.end(), to);
+      if (it == row.end() || *it != to) {
+        error = static_cast<int>(FasStatus::MISSING_EDGE);
+        return;
+      }
+      if (removed[it - neighbors.data()].exchange(true)) {
+        error = static_cast<int>(FasStatus::DUPLICATE_EDGE);
+        return;
+      }
+    }
+  });
+  if (error != static_cast<int>(FasStatus::VALID)) {
+    return static_cast<FasStatus>(error.load());
+  }
+
+  // Kahn's algorithm one level at a time: the vertices whose in-edges are all
+  // gone, then the ones this frees, and so on. Every vertex is reached iff
+  // the rest is acyclic.
+  vector<std::atomic<int>> in_degree(n);
+  for_blocks(n, [&](size_t, size_t begin, size_t end) {
+    for (size_t v = begin; v < end; v++) {
+      for (size_t k = offsets[v]; k < offsets[v + 1]; k++) {
+        if (!removed[k].load(std::memory_order_relaxed)) {
+          in_degree[neighbors[k]].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+  });
+  vector<int> frontier;
+  for (int v = 0; v < n; v++) {
+    if (in_degree[v].load(std::memory_order_relaxed) == 0) {
+      frontier.push_back(v);
+    }
+  }
+  size_t reached = 0;
+  vector<vector<int>> next;
+  while (!frontier.empty()) {
+    reached += frontier.size();
+    next.assign(blocks(frontier.size()), {});
+    for_blocks(frontier.size(), [&](size_t b, size_t begin, size_t end) {
+      vector<int> &freed = next[b];
+      for (size_t i = begin; i < end; i++) {
+        const int v = frontier[i];
+        for (size_t k = offsets[v]; k < offsets[v + 1]; k++) {
+          if (!removed[k].load(std::memory_order_relaxed) &&
+              in_degree[neighbors[k]].fetch_sub(
+                  1, std::memory_order_acq_rel) == 1) {
+            freed.push_back(neighbors[k]);
+          }
+        }
+      }
+    });
+    frontier.clear();
+    for (const vector<int> &freed : next) {
+      frontier.insert(frontier.end(), freed.begin(), freed.end());
+    }
+  }
+  return reached == static_cast<size_t>(n) ? FasStatus::VALID
+                                           : FasStatus::CYCLIC;
+}
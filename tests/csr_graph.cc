@@ -0,0 +1,53 @@
+#include "common.h"
+#include <cassert>
+#include <cstdio>
+
+int main() {
+  SparseMatrix mat(5);
+  add_edge(mat, 0, 3);
+  add_edge(mat, 0, 1);
+  add_edge(mat, 1, 2);
+  add_edge(mat, 2, 0);
+  add_edge(mat, 2, 3);
+  add_edge(mat, 3, 0);
+  add_edge(mat, 4, 0);
+
+  CSRGraph g = to_csr(mat);
+  assert(g.size() == 5);
+  assert(g.n_edges() == 7);
+  for (int i = 0; i < g.size(); i++) {
+    assert(g.out_degree(i) == get_out_degree(mat, i));
+    assert(g.in_degree(i) == get_in_degree(mat, i));
+    int prev = -1;
+    for (const int j : g.out(i)) {
+      assert(j > prev); // Sorted and no duplicates
+      assert(mat[i].find(j) != mat[i].end());
+      assert(g.has_edge(i, j));
+      assert(g.neighbors()[g.edge_position(i, j)] == j);
+      prev = j;
+    }
+    for (const int j : g.in(i)) {
+      assert(g.has_edge(j, i));
+    }
+  }
+  assert(!g.has_edge(1, 0));
+  assert(g.edge_position(1, 0) == -1);
+  assert(g.edge_position(0, 3) == 1);
+  puts("CSR conversion test success.");
+
+  CSRBuilder builder(3);
+  builder.add_edge(2, 1);
+  builder.add_edge(0, 1);
+  builder.add_edge(2, 0);
+  builder.add_edge(2, 1); // Duplicated
+  CSRGraph h = builder.build(false);
+  assert(!h.has_transpose());
+  assert(h.n_edges() == 3);
+  assert(h.out_degree(2) == 2 && h.out(2)[0] == 0 && h.out(2)[1] == 1);
+  assert(h.in_degree(1) == 2);
+
+  SparseMatrix back = to_sparse_matrix(h);
+  assert(back[2].size() == 2 && back[0].size() == 1 && back[1].empty());
+  puts("CSR builder test success.");
+  return 0;
+}
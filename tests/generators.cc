@@ -0,0 +1,95 @@
+#include "common.h"
+#include "generators.h"
+#include "graph_io.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+static bool same_graph(const CSRGraph &a, const CSRGraph &b) {
+  return a.size() == b.size() &&
+         std::equal(a.offsets().begin(), a.offsets().end(),
+                    b.offsets().begin(), b.offsets().end()) &&
+         std::equal(a.neighbors().begin(), a.neighbors().end(),
+                    b.neighbors().begin(), b.neighbors().end());
+}
+
+static bool has_self_loop(const CSRGraph &g) {
+  for (int v = 0; v < g.size(); v++) {
+    if (g.has_edge(v, v)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Edges present in both graphs.
+static size_t shared_edges(const CSRGraph &a, const CSRGraph &b) {
+  size_t shared = 0;
+  for (int v = 0; v < a.size() && v < b.size(); v++) {
+    for (const int u : a.out(v)) {
+      shared += b.has_edge(v, u);
+    }
+  }
+  return shared;
+}
+
+int main() {
+  // Sparse enough that few draws collide. The chunks of 2^20 draws make the
+  // thread count matter if anything does.
+  const CSRGraph er = erdos_renyi_graph(100000, 1100000, 7, 1);
+  assert(er.size() == 100000 && er.has_transpose());
+  assert(er.n_edges() <= 1100000 && er.n_edges() > 1090000);
+  assert(!has_self_loop(er));
+  assert(same_graph(er, erdos_renyi_graph(100000, 1100000, 7, 3)));
+  // Adjacent seeds draw every chunk from unrelated streams, so they share
+  // only the ~120 edges two random graphs of this density would.
+  const CSRGraph next_seed = erdos_renyi_graph(100000, 1100000, 8, 1);
+  assert(!same_graph(er, next_seed));
+  assert(shared_edges(er, next_seed) < 1000);
+  assert(erdos_renyi_graph(1, 10, 7).n_edges() == 0);
+  puts("Erdos-Renyi test success.");
+
+  const CSRGraph rmat = rmat_graph(12, 40000, 3);
+  assert(rmat.size() == 4096 && rmat.n_edges() <= 40000);
+  assert(!has_self_loop(rmat));
+  assert(same_graph(rmat, rmat_graph(12, 40000, 3, 2)));
+  // Skewed degrees: the largest is far above the average of about 10.
+  uint32_t max_degree = 0;
+  for (int v = 0; v < rmat.size(); v++) {
+    max_degree = std::max(max_degree, rmat.out_degree(v));
+  }
+  assert(max_degree > 100);
+  puts("R-MAT test success.");
+
+  std::vector<int> order;
+  const CSRGraph planted = planted_fas_graph(2000, 20000, 150, 5, order);
+  assert(planted.size() == 2000 && order.size() == 2000);
+  std::vector<int> sorted = order;
+  std::sort(sorted.begin(), sorted.end());
+  for (int v = 0; v < 2000; v++) {
+    assert(sorted[v] == v);
+  }
+  // Only the planted edges point backward, barely any of them merged.
+  const size_t bound = backward_edges(planted, order).size();
+  assert(bound <= 150 && bound > 140);
+  std::vector<int> other;
+  assert(same_graph(planted,
+                    planted_fas_graph(2000, 20000, 150, 5, other, 3)));
+  assert(other == order);
+  assert(backward_edges(planted_fas_graph(2000, 20000, 0, 5, other), other)
+             .empty());
+  puts("Planted FAS test success.");
+
+  // Generated graphs survive the text format.
+  const bool written = write_edge_list("generators_test.txt", planted);
+  assert(written);
+  CSRGraph read;
+  const ReadStatus status = read_edge_list("generators_test.txt", read);
+  assert(status == ReadStatus::OK);
+  assert(same_graph(read, planted));
+  std::remove("generators_test.txt");
+  puts("Edge list write test success.");
+  return 0;
+}
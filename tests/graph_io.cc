@@ -0,0 +1,116 @@
+#include "graph_io.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+static std::string write_file(const char *name, const std::string &content) {
+  const std::string path = std::string("graph_io_test_") + name + ".txt";
+  FILE *file = fopen(path.c_str(), "w");
+  fputs(content.c_str(), file);
+  fclose(file);
+  return path;
+}
+
+int main() {
+  // Both separators, a duplicated edge, Windows line ends and no final newline.
+  const std::string path =
+      write_file("ok", "5\n0 3\n0,1\r\n1 , 2\n2  0\n2,3\n3 0\n4,0\n0 1\n2,3");
+  CSRGraph g;
+  ReadStatus status = read_edge_list(path, g);
+  assert(status == ReadStatus::OK);
+  assert(g.size() == 5 && g.n_edges() == 7 && g.has_transpose());
+  assert(g.out_degree(0) == 2 && g.out(0)[0] == 1 && g.out(0)[1] == 3);
+  assert(g.has_edge(1, 2) && g.has_edge(2, 0) && g.has_edge(4, 0));
+  assert(g.in_degree(0) == 3);
+  // Any number of threads gives the same graph.
+  for (const int n_threads : {1, 3}) {
+    CSRGraph h;
+    status = read_edge_list(path, h, n_threads);
+    assert(status == ReadStatus::OK);
+    assert(std::equal(h.offsets().begin(), h.offsets().end(),
+                      g.offsets().begin(), g.offsets().end()));
+    assert(std::equal(h.neighbors().begin(), h.neighbors().end(),
+                      g.neighbors().begin(), g.neighbors().end()));
+  }
+  puts("Edge list read test success.");
+
+  // A cache round trip gives the same arrays, and is picked up by read_graph.
+  const std::string cache = "graph_io_test_cache.bin";
+  bool written = write_graph_cache(cache, g);
+  assert(written);
+  CSRGraph mapped;
+  status = read_graph(cache, mapped);
+  assert(status == ReadStatus::OK);
+  status = read_graph(path, g);
+  assert(status == ReadStatus::OK);
+  {
+    // Copies keep the mapping alive.
+    CSRGraph copy = mapped;
+    mapped = CSRGraph();
+    mapped = copy;
+  }
+  assert(mapped.size() == g.size() && mapped.has_transpose());
+  assert(std::equal(mapped.neighbors().begin(), mapped.neighbors().end(),
+                    g.neighbors().begin(), g.neighbors().end()));
+  assert(std::equal(mapped.in_offsets().begin(), mapped.in_offsets().end(),
+                    g.in_offsets().begin(), g.in_offsets().end()));
+  // Without the transposed copy in the file, it is built on load.
+  written = write_graph_cache(cache, CSRGraph(2, {0, 1, 1}, {1}, false));
+  assert(written);
+  status = read_graph_cache(cache, mapped);
+  assert(status == ReadStatus::OK);
+  assert(mapped.has_transpose() && mapped.in(1)[0] == 0);
+  remove(path.c_str());
+  puts("Graph cache test success.");
+
+  status = read_edge_list("graph_io_test_missing.txt", g);
+  assert(status == ReadStatus::NOT_FOUND);
+  const std::string bad[][2] = {{"size", "x\n0 1\n"},
+                                {"range", "2\n0 1\n1 2\n"},
+                                {"separator", "2\n0;1\n"},
+                                {"truncated", "2\n0 1\n1"}};
+  for (const auto &[name, content] : bad) {
+    const std::string bad_path = write_file(name.c_str(), content);
+    const ReadStatus expected =
+        name == "size" ? ReadStatus::BAD_SIZE : ReadStatus::BAD_EDGE;
+    status = read_edge_list(bad_path, g);
+    assert(status == expected);
+    remove(bad_path.c_str());
+  }
+  // Overwrites the int at offset in the cache file.
+  const auto patch = [&cache](long offset, int value) {
+    FILE *file = fopen(cache.c_str(), "r+b");
+    fseek(file, sizeof(graph_cache_header_t) + offset, SEEK_SET);
+    fwrite(&value, sizeof(int), 1, file);
+    fclose(file);
+  };
+  // A neighbor out of range, in the last entry of the out-neighbor array.
+  written = write_graph_cache(cache, CSRGraph(2, {0, 1, 1}, {1}, false));
+  assert(written);
+  patch(3 * sizeof(size_t), 2);
+  status = read_graph(cache, g);
+  assert(status == ReadStatus::BAD_FORMAT);
+  // A row out of order.
+  written = write_graph_cache(cache, CSRGraph(3, {0, 2, 2, 2}, {2, 1}, false));
+  assert(written);
+  status = read_graph(cache, g);
+  assert(status == ReadStatus::BAD_FORMAT);
+  // A transposed copy that lists 1 -> 1 in place of 0 -> 1. The in-arrays
+  // start after 3 offsets and the neighbor padded to 8 bytes.
+  written = write_graph_cache(cache, CSRGraph(2, {0, 1, 1}, {1}));
+  assert(written);
+  status = read_graph(cache, g);
+  assert(status == ReadStatus::OK);
+  patch(4 * sizeof(size_t) + 3 * sizeof(size_t), 1);
+  status = read_graph(cache, g);
+  assert(status == ReadStatus::BAD_FORMAT);
+  truncate(cache.c_str(), 40);
+  status = read_graph(cache, g);
+  assert(status == ReadStatus::BAD_FORMAT);
+  remove(cache.c_str());
+  puts("Malformed graph file test success.");
+  return 0;
+}
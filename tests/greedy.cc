@@ -1,6 +1,34 @@
 #include "common.h"
+#include <cassert>
 #include <cstdio>
 
+// Whether mat is acyclic once the edges in fas are removed (Kahn's algorithm).
+static bool breaks_all_cycles(SparseMatrix mat, const FAS &fas) {
+  for (const Edge &e : fas) {
+    remove_edge(mat, e);
+  }
+  const int n = mat.size();
+  std::vector<int> d_in(n, 0), queue;
+  for (int i = 0; i < n; i++) {
+    for (const auto &[j, _] : mat[i]) {
+      d_in[j]++;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (d_in[i] == 0) {
+      queue.push_back(i);
+    }
+  }
+  for (size_t k = 0; k < queue.size(); k++) {
+    for (const auto &[j, _] : mat[queue[k]]) {
+      if (--d_in[j] == 0) {
+        queue.push_back(j);
+      }
+    }
+  }
+  return queue.size() == static_cast<size_t>(n);
+}
+
 int main() {
   SparseMatrix mat0(4);
   add_edge(mat0, 0, 1);
@@ -8,10 +36,11 @@ int main() {
   add_edge(mat0, 2, 3);
   add_edge(mat0, 3, 0);
   add_edge(mat0, 3, 1);
-  FAS fas = greedy_fas(mat0);
+  FAS fas = greedy_fas(to_csr(mat0));
   print_ans(fas);
   std::puts("");
-  fas = greedy_fas_optimized(mat0);
+  fas = greedy_fas_optimized(to_csr(mat0));
+  assert(breaks_all_cycles(mat0, fas));
   print_ans(fas);
   std::puts("");
 
@@ -22,10 +51,11 @@ int main() {
   add_edge(mat1, 2, 3);
   add_edge(mat1, 3, 0);
   add_edge(mat1, 3, 1);
-  fas = greedy_fas(mat1);
+  fas = greedy_fas(to_csr(mat1));
   print_ans(fas);
   std::puts("");
-  fas = greedy_fas_optimized(mat1);
+  fas = greedy_fas_optimized(to_csr(mat1));
+  assert(breaks_all_cycles(mat1, fas));
   print_ans(fas);
   std::puts("");
 
@@ -41,10 +71,24 @@ int main() {
   add_edge(mat_std, 5, 6);
   add_edge(mat_std, 6, 4);
 
-  fas = greedy_fas(mat_std);
+  fas = greedy_fas(to_csr(mat_std));
+  print_ans(fas);
+  std::puts("");
+  fas = greedy_fas_optimized(to_csr(mat_std));
+  assert(breaks_all_cycles(mat_std, fas) && fas.size() == 2);
   print_ans(fas);
   std::puts("");
-  fas = greedy_fas_optimized(mat_std);
+
+  // Vertices turn into sinks and sources as others are removed, and the
+  // graph may come without in-neighbors.
+  SparseMatrix chain(5);
+  add_edge(chain, 0, 1);
+  add_edge(chain, 1, 2);
+  add_edge(chain, 2, 1);
+  add_edge(chain, 2, 3);
+  add_edge(chain, 3, 4);
+  fas = greedy_fas_optimized(to_csr(chain, false));
+  assert(breaks_all_cycles(chain, fas) && fas.size() == 1);
   print_ans(fas);
   return 0;
 }
\ No newline at end of file
@@ -1,30 +1,86 @@
 #include "page_rank.h"
 
 #include "common.h"
+#include "generators.h"
+#include "thread_pool.h"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <numeric>
 
-int main(int argc, const char *argv[]) {
+int main(int argc, const char *[]) {
   constexpr int size = 5;
   SparseMatrix mat(size);
 
-  mat[0] = {{1, 1}, {2, 1}, {4, 1}};
-  mat[1] = {{0, 1}, {4, 1}};
-  mat[2] = {{1, 1}, {3, 1}};
-  mat[3] = {{0, 1}, {1, 1}};
-  mat[4] = {{3, 1}};
+  for (const Edge &e : {Edge{0, 1}, {0, 2}, {0, 4}, {1, 0}, {1, 4}, {2, 1},
+                       {2, 3}, {3, 0}, {3, 1}, {4, 3}}) {
+    add_edge(mat, e.first, e.second);
+  }
 
   const float expected[] = {0.232071, 0.237557, 0.095753, 0.237903, 0.196715};
 
-  auto rank = prfas::page_rank(mat, 0.85, 30);
-  for (int i = 0; i < rank.size(); i++) {
+  auto rank = prfas::page_rank(to_csr(mat), 0.85, 30);
+  for (size_t i = 0; i < rank.size(); i++) {
     assert(std::fabs(rank[i] - expected[i]) < 1e-3);
     // printf("%f ", i);
   }
+  // Rows are split over threads, but the result must not change.
+  ThreadPool pool(4);
+  prfas::page_rank_options_t options{0.85, 30, 1e-5, &pool};
+  assert(prfas::page_rank(to_csr(mat), options) == rank);
   puts("PageRank test success.");
 
+  // Every solver should converge to the same ranks, with and without teleport.
+  for (const float beta : {0.85f, 1.0f}) {
+    options = {beta, 1000, 1e-7};
+    const auto reference = prfas::page_rank(to_csr(mat), options);
+    for (const PageRankSolver solver :
+         {PageRankSolver::GAUSS_SEIDEL, PageRankSolver::EXTRAPOLATION}) {
+      prfas::page_rank_stats_t stats;
+      options.solver = solver;
+      options.stats = &stats;
+      const auto other = prfas::page_rank(to_csr(mat), options);
+      assert(stats.converged && stats.iterations > 0);
+      for (int i = 0; i < size; i++) {
+        assert(std::fabs(other[i] - reference[i]) < 1e-4);
+      }
+    }
+  }
+  puts("PageRank solvers test success.");
+
+  // Stopping on a stable top ends earlier, on the same best vertex.
+  options = {0.85, 1000, 1e-7};
+  const auto full = prfas::page_rank(to_csr(mat), options);
+  prfas::page_rank_stats_t stats;
+  options.stable_iterations = 3;
+  options.stats = &stats;
+  auto early = prfas::page_rank(to_csr(mat), options);
+  assert(stats.stable && !stats.converged);
+  assert(std::max_element(early.begin(), early.end()) - early.begin() ==
+         std::max_element(full.begin(), full.end()) - full.begin());
+  options.stable_iterations = 0;
+  options.stable_gap = 1; // Never reached
+  prfas::page_rank(to_csr(mat), options);
+  assert(!stats.stable && stats.converged);
+  puts("Stable top PageRank test success.");
+
+  // Warm start from the ranks before <4, 3> was removed. Both sweeps and
+  // residual pushes should land on the new ranks.
+  options = {0.85, 100, 1e-6};
+  const auto cold = prfas::page_rank(to_csr(mat), options);
+  remove_edge(mat, {4, 3});
+  add_edge(mat, 4, 2);
+  const auto expected_new = prfas::page_rank(to_csr(mat), options);
+  const auto warm = prfas::page_rank(to_csr(mat), options, cold);
+  options.residual_push = true;
+  const auto pushed = prfas::page_rank(to_csr(mat), options, cold);
+  for (int i = 0; i < size; i++) {
+    assert(std::fabs(warm[i] - expected_new[i]) < 1e-4);
+    assert(std::fabs(pushed[i] - expected_new[i]) < 1e-4);
+  }
+  puts("Warm started PageRank test success.");
+
   mat = SparseMatrix(4);
   add_edge(mat, 0, 1);
   add_edge(mat, 0, 3);
@@ -38,21 +94,21 @@ int main(int argc, const char *argv[]) {
     loop_based_line_graph_gen = true;
   }
   printf("Using loop for line graph : %d\n", loop_based_line_graph_gen);
-  auto p = prfas::line_graph(mat);
+  auto p = prfas::line_graph(to_csr(mat));
   auto edges = p.second;
   auto e_graph = p.first;
   int n_lg_edges = 0;
   for (int i = 0; i < e_graph.size(); i++) {
-    for (auto kv : e_graph[i]) {
+    for (const int j : e_graph.out(i)) {
       Edge e_in = edges[i];
-      Edge e_out = edges[kv.first];
-      assert(mat[e_in.first][e_in.second] == 1);   // in edge exists
-      assert(mat[e_out.first][e_out.second] == 1); // out edge exists
+      Edge e_out = edges[j];
+      assert(mat.has_edge(e_in.first, e_in.second));   // in edge exists
+      assert(mat.has_edge(e_out.first, e_out.second)); // out edge exists
       assert(e_in.second == e_out.first);          // e_in --> V --> e_out
       // printf("(%d,%d)->(%d,%d)\n", e_in.first, e_in.second, e_out.first,
       // e_out.second);
     }
-    n_lg_edges += e_graph[i].size();
+    n_lg_edges += e_graph.out_degree(i);
   }
   int n_expected_lg_edges = 0;
   for (int i = 0; i < mat.size(); i++) {
@@ -61,6 +117,57 @@ int main(int argc, const char *argv[]) {
   assert(n_expected_lg_edges == n_lg_edges); // Fixed!
   puts("Line Graph test success.");
 
+  // Both generators number line graph vertices by CSR position.
+  const CSRGraph g = to_csr(mat);
+  loop_based_line_graph_gen = !loop_based_line_graph_gen;
+  auto other = prfas::line_graph(g);
+  loop_based_line_graph_gen = !loop_based_line_graph_gen;
+  assert(other.second == edges);
+  assert(other.first.n_edges() == e_graph.n_edges());
+  for (int i = 0; i < e_graph.size(); i++) {
+    assert(edges[i] == g.edge_at(i));
+    assert(std::equal(e_graph.out(i).begin(), e_graph.out(i).end(),
+                      other.first.out(i).begin(), other.first.out(i).end()));
+  }
+  puts("Line Graph numbering test success.");
+
+  // Rows filled on a pool, and the transpose given with them, match a plain
+  // build. Big enough for several chunks per pool thread.
+  const CSRGraph dense = erdos_renyi_graph(3000, 60000, 5);
+  for (const bool loop : {false, true}) {
+    loop_based_line_graph_gen = loop;
+    const CSRGraph serial = prfas::line_graph(dense).first;
+    const CSRGraph threaded = prfas::line_graph(dense, &pool).first;
+    const CSRGraph rebuilt(serial.size(),
+                           {serial.offsets().begin(), serial.offsets().end()},
+                           {serial.neighbors().begin(),
+                            serial.neighbors().end()});
+    for (const auto &[a, b] : {std::make_pair(&serial, &threaded),
+                               std::make_pair(&serial, &rebuilt)}) {
+      assert(std::equal(a->offsets().begin(), a->offsets().end(),
+                        b->offsets().begin(), b->offsets().end()));
+      assert(std::equal(a->neighbors().begin(), a->neighbors().end(),
+                        b->neighbors().begin(), b->neighbors().end()));
+      assert(std::equal(a->in_offsets().begin(), a->in_offsets().end(),
+                        b->in_offsets().begin(), b->in_offsets().end()));
+      assert(std::equal(a->in_neighbors().begin(), a->in_neighbors().end(),
+                        b->in_neighbors().begin(), b->in_neighbors().end()));
+    }
+  }
+  loop_based_line_graph_gen = argc > 1;
+  puts("Parallel line graph test success.");
+
+  // Implicit line graph PageRank should match ranking the built line graph.
+  auto lg_rank = prfas::page_rank(e_graph, 0.85, 30);
+  auto implicit_rank = prfas::line_graph_page_rank(g, 0.85, 30);
+  assert(implicit_rank.size() == edges.size());
+  for (size_t i = 0; i < edges.size(); i++) {
+    int64_t pos = g.edge_position(edges[i].first, edges[i].second);
+    assert(g.edge_at(pos) == edges[i]);
+    assert(std::fabs(lg_rank[i] - implicit_rank[pos]) < 1e-5);
+  }
+  puts("Implicit line graph PageRank test success.");
+
   SparseMatrix mat_std(7);
 
   // Use standard example from TA's PPT.
@@ -74,16 +181,16 @@ int main(int argc, const char *argv[]) {
   add_edge(mat_std, 5, 6);
   add_edge(mat_std, 6, 4);
 
-  prfas::SCC_Solver g1(mat_std);
+  const CSRGraph g_std = to_csr(mat_std);
+  prfas::SCC_Solver g1(g_std);
   auto sccs = g1();
   for (const prfas::SCC &p : sccs) {
     auto m = p.first;
     auto v = p.second;
-    for (int i = 0; i < v.size(); i++) {
-      for (auto kv : m[i]) {
-        int j = kv.first;
+    for (int i = 0; i < static_cast<int>(v.size()); i++) {
+      for (const int j : m.out(i)) {
         // See if we can recover each edge correctly.
-        assert(mat_std[v[i]][v[j]] == 1);
+        assert(mat_std.has_edge(v[i], v[j]));
         // printf("scc[%d, %d]=>mat[%d, %d]=%d\n", i, j, v[i], v[j],
         //        mat_std[v[i]][v[j]]);
       }
@@ -92,12 +199,174 @@ int main(int argc, const char *argv[]) {
   }
   puts("SCC extraction test success.");
 
-  FAS result = page_rank_fas(mat_std);
+  // Removing <3, 0> from {0, 1, 2, 3} leaves the cycle 1 -> 2 -> 3 -> 1.
+  for (const prfas::SCC &p : sccs) {
+    if (p.second.size() != 4) {
+      continue;
+    }
+    const auto &v = p.second;
+    int from = std::find(v.begin(), v.end(), 3) - v.begin();
+    int to = std::find(v.begin(), v.end(), 0) - v.begin();
+    std::vector<prfas::SCC> children;
+    std::vector<size_t> pos = {size_t(p.first.edge_position(from, to))};
+    prfas::remove_and_split(p, pos, children);
+    assert(children.size() == 1);
+    std::vector<int> child_v = children[0].second;
+    std::sort(child_v.begin(), child_v.end());
+    assert(child_v == std::vector<int>({1, 2, 3}));
+    assert(children[0].first.n_edges() == 3);
+  }
+  // Edges marked removed count as gone: without 6 -> 4 only {0, 1, 2, 3}
+  // is left, and its rows still come out sorted.
+  std::vector<bool> removed(g_std.n_edges(), false);
+  removed[g_std.edge_position(6, 4)] = true;
+  prfas::SCC_Solver masked(g_std, &removed);
+  masked();
+  assert(masked.result_scc.size() == 1);
+  const prfas::SCC &left = masked.result_scc[0];
+  assert(left.second == std::vector<int>({0, 1, 2, 3}));
+  assert(left.first.n_edges() == 5 && left.first.has_transpose());
+  for (int v = 0; v < left.first.size(); v++) {
+    assert(std::is_sorted(left.first.out(v).begin(), left.first.out(v).end()));
+  }
+  puts("SCC re-split test success.");
+
+  // A cycle far deeper than a recursive DFS could go, then a graph with two
+  // components again on the reused workspace.
+  const int ring_size = 1000000;
+  CSRBuilder ring(ring_size);
+  for (int v = 0; v < ring_size; v++) {
+    ring.add_edge(v, (v + 1) % ring_size);
+  }
+  const CSRGraph ring_g = ring.build();
+  prfas::SCC_Solver deep(ring_g);
+  deep();
+  assert(deep.result_scc.size() == 1 &&
+         deep.result_scc[0].second.size() == ring_size);
+  prfas::SCC_Solver again(g_std);
+  again();
+  assert(again.result_scc.size() == 2);
+  assert(again.result_scc[0].second == sccs[0].second);
+  assert(again.result_scc[1].second == sccs[1].second);
+  puts("Deep SCC test success.");
+
+  // parallel_scc finds the same components as Tarjan, here on a sparse graph
+  // with many of them, and with edges masked out.
+  const CSRGraph sparse = erdos_renyi_graph(20000, 26000, 11);
+  std::vector<bool> mask(sparse.n_edges(), false);
+  for (size_t e = 0; e < mask.size(); e += 7) {
+    mask[e] = true;
+  }
+  ThreadPool scc_pool(4);
+  for (const auto &[graph, removed] :
+       std::vector<std::pair<const CSRGraph *, const std::vector<bool> *>>{
+           {&sparse, nullptr}, {&sparse, &mask}, {&g_std, nullptr}}) {
+    prfas::SCC_Solver tarjan(*graph, removed);
+    tarjan();
+    prfas::sort_by_first_vertex(tarjan.result_scc);
+    const std::vector<prfas::SCC> parallel =
+        prfas::parallel_scc(*graph, scc_pool, removed);
+    assert(parallel.size() == tarjan.result_scc.size());
+    for (size_t i = 0; i < parallel.size(); i++) {
+      const CSRGraph &a = parallel[i].first, &b = tarjan.result_scc[i].first;
+      assert(parallel[i].second == tarjan.result_scc[i].second);
+      assert(std::equal(a.neighbors().begin(), a.neighbors().end(),
+                        b.neighbors().begin(), b.neighbors().end()));
+    }
+  }
+  puts("Parallel SCC test success.");
+
+  FAS result = page_rank_fas(to_csr(mat_std));
   assert(result.size() == 2);
+  assert(page_rank_fas_stats.runs >= 2 && page_rank_fas_stats.iterations > 0);
   printf("The 2 FAs to be removed:\n");
   for (Edge e : result) {
     printf("<%d, %d>\n", e.first, e.second);
   }
   puts("PageRank FAS test success.");
+
+  implicit_line_graph_page_rank = true;
+  result = page_rank_fas(to_csr(mat_std));
+  assert(result.size() == 2);
+  fas_threads = 4;
+  const FAS threaded = page_rank_fas(to_csr(mat_std));
+  assert(threaded == result);
+  fas_threads = 1;
+  fas_warm_start = fas_residual_push = true;
+  const FAS warm_started = page_rank_fas(to_csr(mat_std));
+  assert(warm_started.size() == 2);
+  fas_warm_start = fas_residual_push = false;
+  fas_page_rank_solver = PageRankSolver::GAUSS_SEIDEL;
+  const FAS gauss_seidel = page_rank_fas(to_csr(mat_std));
+  assert(gauss_seidel.size() == 2);
+  fas_page_rank_solver = PageRankSolver::JACOBI;
+  fas_stable_iterations = 2;
+  const FAS stable = page_rank_fas(to_csr(mat_std));
+  assert(stable == result);
+  fas_stable_iterations = 0;
+  puts("Implicit PageRank FAS test success.");
+
+  // A batch without limit takes every edge tied with the top at once.
+  fas_batch_size = 0;
+  fas_batch_tolerance = 0;
+  result = page_rank_fas(to_csr(mat_std));
+  // All 3 edges of the cycle 4 -> 5 -> 6 -> 4 rank the same.
+  assert(std::count_if(result.begin(), result.end(),
+                       [](Edge e) { return e.first >= 4; }) == 3);
+  // No cap with the default tolerance still takes only ties, not the SCC.
+  const CSRGraph batched = erdos_renyi_graph(200, 1000, 3);
+  const FAS uncapped = page_rank_fas(batched);
+  assert(validate_fas(batched, uncapped) == FasStatus::VALID);
+  assert(uncapped.size() < batched.n_edges() / 2);
+  puts("Batched PageRank FAS test success.");
+
+  // The exact solver against trying every vertex order.
+  for (int n = 2; n <= 7; n++) {
+    for (int seed = 0; seed < 20; seed++) {
+      const CSRGraph small = erdos_renyi_graph(n, n * 2, seed);
+      std::vector<int> order(n), place(n);
+      std::iota(order.begin(), order.end(), 0);
+      size_t best = small.n_edges();
+      do {
+        for (int i = 0; i < n; i++) {
+          place[order[i]] = i;
+        }
+        size_t back = 0;
+        for (int v = 0; v < n; v++) {
+          for (const int u : small.out(v)) {
+            back += place[u] < place[v];
+          }
+        }
+        best = std::min(best, back);
+      } while (std::next_permutation(order.begin(), order.end()));
+      const std::vector<size_t> pos = prfas::exact_fas(small);
+      assert(pos.size() == best);
+      assert(std::is_sorted(pos.begin(), pos.end()));
+      FAS fas;
+      for (const size_t k : pos) {
+        fas.push_back(small.edge_at(k));
+      }
+      assert(validate_fas(small, fas) == FasStatus::VALID);
+    }
+  }
+  // Every vertex in one SCC, at the size limit.
+  CSRBuilder complete(prfas::EXACT_FAS_MAX_SIZE);
+  for (int v = 0; v < prfas::EXACT_FAS_MAX_SIZE; v++) {
+    for (int u = 0; u < prfas::EXACT_FAS_MAX_SIZE; u++) {
+      if (u != v) {
+        complete.add_edge(v, u);
+      }
+    }
+  }
+  // A tournament keeps one direction of each pair.
+  assert(prfas::exact_fas(complete.build()).size() ==
+         prfas::EXACT_FAS_MAX_SIZE * (prfas::EXACT_FAS_MAX_SIZE - 1) / 2);
+
+  fas_batch_size = 1;
+  fas_exact_size = 16;
+  result = page_rank_fas(to_csr(mat_std));
+  assert(result.size() == 2);
+  assert(page_rank_fas_stats.runs == 0 && page_rank_fas_stats.exact == 2);
+  puts("Exact small SCC test success.");
   return 0;
 }
\ No newline at end of file
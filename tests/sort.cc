@@ -1,4 +1,5 @@
 #include "common.h"
+#include <cassert>
 #include <cstdio>
 
 int main() {
@@ -9,7 +10,7 @@ int main() {
   add_edge(mat0, 2, 3);
   add_edge(mat0, 3, 0);
   add_edge(mat0, 3, 1);
-  FAS fas = sort_fas(mat0);
+  FAS fas = sort_fas(to_csr(mat0));
   print_ans(fas);
   std::puts("");
 
@@ -20,7 +21,7 @@ int main() {
   add_edge(mat1, 2, 3);
   add_edge(mat1, 3, 0);
   add_edge(mat1, 3, 1);
-  fas = sort_fas(mat1);
+  fas = sort_fas(to_csr(mat1));
   print_ans(fas);
   std::puts("");
 
@@ -35,7 +36,19 @@ int main() {
   add_edge(mat_std, 5, 6);
   add_edge(mat_std, 6, 4);
 
-  FAS fas_std = sort_fas(mat_std);
+  FAS fas_std = sort_fas(to_csr(mat_std));
+  assert(fas_std.size() == 2);
   print_ans(fas_std);
+  std::puts("");
+
+  // Other starting orders can only keep or shrink the FAS, and the result
+  // doesn't depend on the number of threads.
+  const FAS single = sort_fas(to_csr(mat1));
+  sort_fas_multi_start = true;
+  FAS multi = sort_fas(to_csr(mat1, false));
+  assert(multi.size() <= single.size());
+  fas_threads = 3;
+  assert(sort_fas(to_csr(mat1)) == multi);
+  print_ans(multi);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,26 @@
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+int main() {
+  assert(ThreadPool::resolve_size(3) == 3);
+  assert(ThreadPool::resolve_size(0) >= 1);
+  assert(ThreadPool(0).size() == ThreadPool::resolve_size(0));
+  for (const int n_threads : {1, 2, 4}) {
+    ThreadPool pool(n_threads);
+    assert(pool.size() == n_threads);
+    // Reuse the pool for several jobs of different sizes.
+    for (const size_t n : {0, 1, 7, 1000}) {
+      std::vector<std::atomic<int>> hits(n);
+      pool.parallel_for(n, [&](size_t i) { hits[i]++; });
+      for (size_t i = 0; i < n; i++) {
+        assert(hits[i] == 1); // Every task runs exactly once
+      }
+    }
+  }
+  puts("Thread pool test success.");
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include "trace.h"
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main() {
+  { TraceScope off("off"); } // Not recorded
+  trace_enabled = true;
+  trace_reset();
+  {
+    TraceScope outer("outer");
+    outer.arg("size", 3);
+    for (int i = 0; i < 2; i++) {
+      TraceScope inner("inner");
+    }
+    trace_counter("count", 7);
+  }
+  trace_enabled = false;
+  print_trace_summary();
+  assert(memory_stats().allocations == 0); // Not asked for
+  for (const trace_total_t &total : trace_totals()) {
+    assert(total.allocated_bytes == -1 && total.peak_bytes == -1);
+  }
+
+  const std::string path = "trace_test.json";
+  const bool written = write_chrome_trace(path);
+  assert(written);
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    printf("Can't open %s\n", path.c_str());
+    return 1;
+  }
+  char buffer[4096];
+  const size_t n = fread(buffer, 1, sizeof(buffer) - 1, file);
+  fclose(file);
+  remove(path.c_str());
+  const std::string json(buffer, n);
+  assert(json.find("\"off\"") == std::string::npos);
+  assert(json.find("\"name\":\"outer\",\"ph\":\"X\"") != std::string::npos);
+  assert(json.find("\"args\":{\"size\":3}") != std::string::npos);
+  assert(json.find("\"name\":\"count\",\"ph\":\"C\"") != std::string::npos);
+  // 1 outer, 2 inner, 1 counter
+  size_t n_events = 0;
+  for (size_t at = 0; (at = json.find("\"ph\"", at)) != std::string::npos;
+       at++) {
+    n_events++;
+  }
+  assert(n_events == 4);
+  puts("Trace test success.");
+
+  trace_enabled = trace_memory = true;
+  trace_reset();
+  {
+    TraceScope scope("alloc");
+    std::vector<char> big(1 << 20);
+    big[0] = 1;
+  }
+  const memory_stats_t memory = memory_stats();
+  assert(memory.allocations >= 1 && memory.allocated_bytes >= (1 << 20));
+  assert(memory.peak_bytes >= (1 << 20));
+  assert(peak_rss_bytes() != 0);
+  const std::vector<trace_total_t> totals = trace_totals();
+  assert(totals.size() == 1 && totals[0].allocated_bytes >= (1 << 20));
+  print_trace_summary();
+  trace_enabled = trace_memory = false;
+  puts("Memory trace test success.");
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "common.h"
+#include "generators.h"
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main() {
+  // Two cycles, 0 -> 1 -> 2 -> 3 -> 0 with a chord 3 -> 1, and 4 -> 5 -> 6.
+  CSRBuilder builder(7);
+  for (const auto &[from, to] : std::vector<Edge>{
+           {0, 1}, {1, 2}, {2, 3}, {3, 0}, {3, 1}, {4, 5}, {5, 6}, {6, 4}}) {
+    builder.add_edge(from, to);
+  }
+  const CSRGraph g = builder.build();
+  assert(validate_fas(g, {{3, 0}, {3, 1}, {6, 4}}) == FasStatus::VALID);
+  assert(validate_fas(g, {{2, 3}, {5, 6}}) == FasStatus::VALID);
+  assert(validate_fas(g, {{3, 0}, {6, 4}}) == FasStatus::CYCLIC);
+  assert(validate_fas(g, {}) == FasStatus::CYCLIC);
+  assert(validate_fas(g, {{2, 3}, {5, 6}, {0, 2}}) ==
+         FasStatus::MISSING_EDGE);
+  assert(validate_fas(g, {{2, 3}, {5, 6}, {7, 0}}) ==
+         FasStatus::MISSING_EDGE);
+  assert(validate_fas(g, {{2, 3}, {5, 6}, {2, 3}}) ==
+         FasStatus::DUPLICATE_EDGE);
+  assert(validate_fas(CSRBuilder(3).build(), {}) == FasStatus::VALID);
+  puts("Small graph validation test success.");
+
+  // Every solver has to return self-loops, even ones outside any larger SCC.
+  CSRBuilder loops(4);
+  for (const auto &[from, to] : std::vector<Edge>{
+           {0, 0}, {0, 1}, {1, 0}, {1, 2}, {2, 2}, {3, 3}}) {
+    loops.add_edge(from, to);
+  }
+  const CSRGraph with_loops = loops.build();
+  for (const std::string &name : solver_names()) {
+    fas_solver solver;
+    const bool found = select_solver(name, solver);
+    assert(found);
+    const FAS fas = solver(with_loops);
+    assert(validate_fas(with_loops, fas) == FasStatus::VALID);
+    assert(fas.size() == 4);
+  }
+  puts("Self-loop test success.");
+
+  // Big enough for the parallel path, with a known FAS: the planted edges.
+  std::vector<int> order;
+  const CSRGraph planted = planted_fas_graph(50000, 400000, 2000, 9, order);
+  const FAS fas = backward_edges(planted, order);
+  for (const int n_threads : {1, 4}) {
+    assert(validate_fas(planted, fas, n_threads) == FasStatus::VALID);
+  }
+  assert(validate_fas(planted, {}, 4) == FasStatus::CYCLIC);
+  assert(validate_fas(planted, greedy_fas_optimized(planted), 4) ==
+         FasStatus::VALID);
+  // A long path has one vertex per level.
+  CSRBuilder path(100000);
+  for (int v = 0; v + 1 < 100000; v++) {
+    path.add_edge(v, v + 1);
+  }
+  path.add_edge(99999, 0);
+  const CSRGraph ring = path.build();
+  assert(validate_fas(ring, {}) == FasStatus::CYCLIC);
+  assert(validate_fas(ring, {{99999, 0}}) == FasStatus::VALID);
+  assert(validate_fas(ring, {{500, 501}}, 4) == FasStatus::VALID);
+  puts("Large graph validation test success.");
+  return 0;
+}